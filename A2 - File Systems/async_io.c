@@ -0,0 +1,425 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "async_io.h"
+
+#define RING_ENTRIES 32     // Writes submitted to the ring at a time
+#define POOL_THREADS 4      // Threads of the fallback pool
+
+// A queued write and, once done, how it went
+typedef struct write_req {
+    int offset;
+    int length;
+    char *data;
+    int failed;
+} WriteReq;
+
+/* An io_uring set up with raw system calls: the submission queue, the array
+ * of entries it indexes, and the completion queue, all mapped from the
+ * kernel.
+ */
+typedef struct ring {
+    int fd;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} Ring;
+
+// The threads that do the writes when there is no ring
+typedef struct pool {
+    pthread_t threads[POOL_THREADS];
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // Signalled when writes are handed out
+    pthread_cond_t done;        // Signalled when the last of them finishes
+    int fd;
+    WriteReq *reqs;             // The writes handed out, while count > 0
+    int count;
+    int next;                   // The next write to take
+    int finished;
+    int stop;
+} Pool;
+
+struct async_io {
+    int fd;                     // The image, which fs->fp also writes to
+    Ring *ring;                 // The ring, or NULL to use the pool
+    Pool *pool;
+    WriteReq *reqs;
+    int count;
+    int capacity;
+};
+
+/* Write all n bytes of buf at offset, even if it takes several calls.
+ */
+static int write_all(int fd, const char *buf, int n, int offset) {
+    while (n > 0) {
+        ssize_t written = pwrite(fd, buf, n, offset);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += written;
+        offset += written;
+        n -= written;
+    }
+    return 0;
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+static void ring_free(Ring *r) {
+    if (r->sqes != NULL && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_ptr != NULL && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) {
+        munmap(r->cq_ptr, r->cq_size);
+    }
+    if (r->sq_ptr != NULL && r->sq_ptr != MAP_FAILED) {
+        munmap(r->sq_ptr, r->sq_size);
+    }
+    close(r->fd);
+    free(r);
+}
+
+/* Set up a ring, or return NULL if the kernel does not allow one.
+ */
+static Ring *ring_init() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = io_uring_setup(RING_ENTRIES, &p);
+    if (fd == -1) {
+        return NULL;
+    }
+    Ring *r = calloc(1, sizeof(Ring));
+    if (r == NULL) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+
+    // Older kernels map the two queues separately
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size) {
+            r->sq_size = r->cq_size;
+        }
+        r->cq_size = r->sq_size;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        ring_free(r);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            ring_free(r);
+            return NULL;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        ring_free(r);
+        return NULL;
+    }
+
+    char *sq = r->sq_ptr;
+    char *cq = r->cq_ptr;
+    r->sq_head = (unsigned *) (sq + p.sq_off.head);
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    return r;
+}
+
+/* Write reqs[0..n) through the ring, RING_ENTRIES at a time. A write that
+ * the ring could not do, or only did in part, is finished with pwrite().
+ * Return -1 if the ring stopped working, after doing the writes anyway.
+ */
+static int ring_write(Ring *r, int fd, WriteReq *reqs, int n) {
+    int start = 0;
+    while (start < n) {
+        int count = n - start < RING_ENTRIES ? n - start : RING_ENTRIES;
+        unsigned tail = *r->sq_tail;
+        int i;
+
+        for (i = 0; i < count; i++) {
+            WriteReq *w = &reqs[start + i];
+            unsigned index = tail & *r->sq_mask;
+            struct io_uring_sqe *sqe = &r->sqes[index];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = (unsigned long) w->data;
+            sqe->len = w->length;
+            sqe->off = w->offset;
+            sqe->user_data = start + i;
+            r->sq_array[index] = index;
+            tail++;
+        }
+        __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+        int submitted = 0;
+        int completed = 0;
+        while (completed < count) {
+            int ret = io_uring_enter(r->fd, count - submitted,
+                                     count - completed, IORING_ENTER_GETEVENTS);
+            if (ret == -1 && errno != EINTR) {
+                break;
+            }
+            if (ret > 0) {
+                submitted += ret;
+            }
+
+            unsigned head = *r->cq_head;
+            while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+                WriteReq *w = &reqs[cqe->user_data];
+                int done = cqe->res < 0 ? 0 : cqe->res;
+                if (done < w->length) {
+                    w->failed = write_all(fd, w->data + done, w->length - done,
+                                          w->offset + done) == -1;
+                }
+                head++;
+                completed++;
+            }
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        // If the ring itself broke, do the rest without it
+        if (completed < count) {
+            for (i = start; i < n; i++) {
+                WriteReq *w = &reqs[i];
+                w->failed = write_all(fd, w->data, w->length, w->offset) == -1;
+            }
+            return -1;
+        }
+        start += count;
+    }
+    return 0;
+}
+
+/* Take queued writes until told to stop.
+ */
+static void *pool_worker(void *arg) {
+    Pool *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+        while (p->next < p->count) {
+            WriteReq *w = &p->reqs[p->next++];
+            pthread_mutex_unlock(&p->lock);
+            w->failed = write_all(p->fd, w->data, w->length, w->offset) == -1;
+            pthread_mutex_lock(&p->lock);
+            if (++p->finished == p->count) {
+                pthread_cond_signal(&p->done);
+            }
+        }
+        pthread_cond_wait(&p->work, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Write reqs[0..n) through the pool.
+ */
+static void pool_write(Pool *p, WriteReq *reqs, int n) {
+    pthread_mutex_lock(&p->lock);
+    p->reqs = reqs;
+    p->count = n;
+    p->next = 0;
+    p->finished = 0;
+    pthread_cond_broadcast(&p->work);
+    while (p->finished < n) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    p->count = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static Pool *pool_init(int fd) {
+    Pool *p = calloc(1, sizeof(Pool));
+    if (p == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    p->fd = fd;
+
+    while (p->started < POOL_THREADS &&
+            pthread_create(&p->threads[p->started], NULL, pool_worker, p) == 0) {
+        p->started++;
+    }
+    if (p->started == 0) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+static void pool_free(Pool *p) {
+    int i;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 0; i < p->started; i++) {
+        pthread_join(p->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+    free(p);
+}
+
+int aio_start(FS *fs, int use_uring) {
+    if (fs->aio != NULL) {
+        aio_stop(fs);
+    }
+    struct async_io *aio = calloc(1, sizeof(struct async_io));
+    if (aio == NULL) {
+        return SIMFS_ENOMEM;
+    }
+    aio->fd = fileno(fs->fp);
+
+    if (use_uring) {
+        aio->ring = ring_init();
+    }
+    if (aio->ring == NULL && (aio->pool = pool_init(aio->fd)) == NULL) {
+        free(aio);
+        return SIMFS_ENOMEM;
+    }
+    fs->aio = aio;
+    return SIMFS_OK;
+}
+
+void aio_stop(FS *fs) {
+    struct async_io *aio = fs->aio;
+    if (aio == NULL) {
+        return;
+    }
+    if (aio->ring != NULL) {
+        ring_free(aio->ring);
+    }
+    if (aio->pool != NULL) {
+        pool_free(aio->pool);
+    }
+    free(aio->reqs);
+    free(aio);
+    fs->aio = NULL;
+}
+
+const char *aio_engine(FS *fs) {
+    return fs->aio->ring != NULL ? "io_uring" : "threads";
+}
+
+int aio_queue(FS *fs, int offset, const char *data, int n) {
+    struct async_io *aio = fs->aio;
+
+    if (aio->count == aio->capacity) {
+        int capacity = aio->capacity == 0 ? MAXFILES : aio->capacity * 2;
+        WriteReq *reqs = realloc(aio->reqs, capacity * sizeof(WriteReq));
+        if (reqs == NULL) {
+            return SIMFS_ENOMEM;
+        }
+        aio->reqs = reqs;
+        aio->capacity = capacity;
+    }
+
+    WriteReq *w = &aio->reqs[aio->count];
+    w->data = malloc(n);
+    if (w->data == NULL) {
+        return SIMFS_ENOMEM;
+    }
+    memcpy(w->data, data, n);
+    w->offset = offset;
+    w->length = n;
+    w->failed = 0;
+    aio->count++;
+    return SIMFS_OK;
+}
+
+const char *aio_queued(FS *fs, int offset, int n) {
+    int i;
+    // The latest write wins, as it would on disk
+    for (i = fs->aio->count - 1; i >= 0; i--) {
+        WriteReq *w = &fs->aio->reqs[i];
+        if (w->offset == offset && w->length == n) {
+            return w->data;
+        }
+    }
+    return NULL;
+}
+
+int aio_flush(FS *fs, void (*failed)(FS *fs, int offset, int n)) {
+    struct async_io *aio = fs->aio;
+    int error = SIMFS_OK;
+    int i;
+
+    if (aio->count == 0) {
+        return SIMFS_OK;
+    }
+    // Anything stdio holds for the image must reach it first
+    fflush(fs->fp);
+
+    if (aio->ring != NULL) {
+        if (ring_write(aio->ring, aio->fd, aio->reqs, aio->count) == -1) {
+            ring_free(aio->ring);
+            aio->ring = NULL;
+            aio->pool = pool_init(aio->fd);
+        }
+    } else if (aio->pool != NULL) {
+        pool_write(aio->pool, aio->reqs, aio->count);
+    } else {
+        for (i = 0; i < aio->count; i++) {
+            WriteReq *w = &aio->reqs[i];
+            w->failed = write_all(aio->fd, w->data, w->length, w->offset) == -1;
+        }
+    }
+
+    // Drop what stdio may have read of the image before these writes
+    fflush(fs->fp);
+
+    for (i = 0; i < aio->count; i++) {
+        if (aio->reqs[i].failed) {
+            failed(fs, aio->reqs[i].offset, aio->reqs[i].length);
+            error = SIMFS_EIO;
+        }
+        free(aio->reqs[i].data);
+    }
+    aio->count = 0;
+    return error;
+}
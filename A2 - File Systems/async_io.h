@@ -0,0 +1,38 @@
+#ifndef ASYNC_IO_H_
+#define ASYNC_IO_H_
+
+#include "file_ops.h"
+
+/* Asynchronous data writes. While a batch of changes is under way, the data
+ * of each new file is queued instead of written, and the whole queue is
+ * submitted at once when the batch ends: through an io_uring when the
+ * kernel allows one, or else through a small pool of threads calling
+ * pwrite(). The metadata is written only once every queued write is done.
+ */
+
+/* Start writing asynchronously, with an io_uring if use_uring is set and
+ * one can be set up, or with threads otherwise.
+ */
+int aio_start(FS *fs, int use_uring);
+
+/* Stop writing asynchronously. Nothing may be queued. */
+void aio_stop(FS *fs);
+
+/* The name of the mechanism in use: "io_uring" or "threads". */
+const char *aio_engine(FS *fs);
+
+/* Queue a copy of the n bytes at data to be written at offset. */
+int aio_queue(FS *fs, int offset, const char *data, int n);
+
+/* Return the queued data for the n bytes at offset, or NULL if none is
+ * queued there, so that data not yet written can still be read.
+ */
+const char *aio_queued(FS *fs, int offset, int n);
+
+/* Submit every queued write and wait for them all to finish. For each
+ * write that failed, failed() is called with its offset and length.
+ * Return SIMFS_OK, or SIMFS_EIO if any write failed.
+ */
+int aio_flush(FS *fs, void (*failed)(FS *fs, int offset, int n));
+
+#endif /* ASYNC_IO_H_ */
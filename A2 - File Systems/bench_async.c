@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "transactions.h"
+
+/* Compares synchronous and asynchronous data writes on a large transaction
+ * file. The file fills the file system with up to 16 files and deletes
+ * them again, over and over; it is run once as is and once after each
+ * of "a threads" and "a on", and every run must leave the same image.
+ *
+ * Usage: bench_async [rounds [files [size]]]
+ */
+
+#define MODES 3
+
+static char *modes[MODES] = {NULL, "threads", "on"};
+static char *mode_names[MODES] = {"sync", "threads", "io_uring"};
+
+static double get_time() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Write a transaction file for image to trans, choosing the write mode,
+ * and return the number of transactions in it.
+ */
+static long write_transactions(char *trans, char *image, char *mode,
+                               int rounds, int files, int size) {
+    FILE *fp = fopen(trans, "w");
+    if (fp == NULL) {
+        perror(trans);
+        exit(1);
+    }
+
+    long count = 0;
+    fprintf(fp, "i %s\n", image);
+    if (mode != NULL) {
+        fprintf(fp, "a %s\n", mode);
+        count++;
+    }
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < files; i++) {
+            fprintf(fp, "c f%d %d ", i, size);
+            for (int j = 0; j < size; j++) {
+                fputc('a' + (r + i + j / 8) % 26, fp);
+            }
+            fputc('\n', fp);
+        }
+        // Keep the last round, so the images have something to compare
+        for (int i = 0; r < rounds - 1 && i < files; i++) {
+            fprintf(fp, "d f%d\n", i);
+        }
+        count += r < rounds - 1 ? 2 * files : files;
+    }
+    fprintf(fp, "x\n");
+
+    if (fclose(fp) != 0) {
+        perror(trans);
+        exit(1);
+    }
+    return count + 2;
+}
+
+/* Return 1 if the files a and b have the same contents.
+ */
+static int same_image(char *a, char *b) {
+    FILE *fa = fopen(a, "r");
+    FILE *fb = fopen(b, "r");
+    if (fa == NULL || fb == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    int ca, cb;
+    do {
+        ca = fgetc(fa);
+        cb = fgetc(fb);
+    } while (ca == cb && ca != EOF);
+    fclose(fa);
+    fclose(fb);
+    return ca == cb;
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? strtol(argv[1], NULL, 10) : 20000;
+    int files = argc > 2 ? strtol(argv[2], NULL, 10) : 16;
+    int size = argc > 3 ? strtol(argv[3], NULL, 10) : 64;
+
+    if (rounds <= 0 || files <= 0 || files > MAXFILES || size <= 0 ||
+            files * size > MAX_FS_SIZE || size > MAXLINE - 40) {
+        fprintf(stderr, "Usage: %s [rounds [files [size]]]\n", argv[0]);
+        fprintf(stderr, "At most %d files of %d bytes in all\n", MAXFILES,
+                MAX_FS_SIZE);
+        exit(1);
+    }
+
+    char dir[] = "/tmp/bench_asyncXXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    char trans[MODES][64], image[MODES][64];
+    double elapsed[MODES];
+    long count = 0;
+
+    for (int m = 0; m < MODES; m++) {
+        snprintf(trans[m], sizeof(trans[m]), "%s/%s.txt", dir, mode_names[m]);
+        snprintf(image[m], sizeof(image[m]), "%s/%s.img", dir, mode_names[m]);
+        count = write_transactions(trans[m], image[m], modes[m], rounds,
+                                   files, size);
+
+        double start = get_time();
+        process_transactions(trans[m]);
+        elapsed[m] = get_time() - start;
+    }
+
+    printf("%ld transactions, batches of %d creates of %d bytes\n", count,
+           files, size);
+    for (int m = 0; m < MODES; m++) {
+        printf("%-9s %8.3f s %10.0f transactions/s %6.2fx\n", mode_names[m],
+               elapsed[m], count / elapsed[m], elapsed[0] / elapsed[m]);
+    }
+
+    int same = 1;
+    for (int m = 1; m < MODES; m++) {
+        same = same && same_image(image[0], image[m]);
+    }
+    printf("images %s\n", same ? "match" : "DIFFER");
+
+    for (int m = 0; m < MODES; m++) {
+        unlink(trans[m]);
+        unlink(image[m]);
+    }
+    rmdir(dir);
+    return same ? 0 : 1;
+}
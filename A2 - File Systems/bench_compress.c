@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "file_ops.h"
+#include "free_list.h"
+#include "compress.h"
+
+/* Measures the throughput of compress-on-write. For payloads of several
+ * kinds, prints the ratio and speed of the codec on its own, then the rate
+ * of creating and deleting a file in a simulated file system with and
+ * without compression.
+ *
+ * Usage: bench_compress [rounds]
+ */
+
+#define PAYLOAD (MAX_FS_SIZE / 4)
+#define KINDS 4
+
+static char *kind_names[KINDS] = {"runs", "sample", "text", "random"};
+
+static double get_time() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fill buf with size bytes of payload kind.
+ */
+static void fill(char *buf, int size, int kind) {
+    char *words[] = {"the ", "file ", "system ", "block ", "free ", "list "};
+    int i = 0;
+
+    srand(kind + 1);
+    while (i < size) {
+        if (kind == 0) {            // A few long runs
+            buf[i] = 'a' + i / 64;
+            i++;
+        } else if (kind == 1) {     // Short runs, as in test_sample.txt
+            int len = 4 + rand() % 9;
+            char c = 'a' + rand() % 26;
+            for (int j = 0; j < len && i < size; j++) {
+                buf[i++] = c;
+            }
+        } else if (kind == 2) {     // Words with few repeated letters
+            char *w = words[rand() % 6];
+            for (int j = 0; w[j] != '\0' && i < size; j++) {
+                buf[i++] = w[j];
+            }
+        } else {                    // No runs to find
+            buf[i++] = 'a' + rand() % 26;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    char image[] = "/tmp/bench_compressXXXXXX";
+    char buf[PAYLOAD];
+    char packed[RLE_BOUND(PAYLOAD)];
+    char expanded[PAYLOAD];
+
+    if (rounds <= 0) {
+        fprintf(stderr, "Usage: %s [rounds]\n", argv[0]);
+        exit(1);
+    }
+
+    int fd = mkstemp(image);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    printf("%d byte payloads, %d rounds\n", PAYLOAD, rounds);
+    printf("%-8s %7s %12s %12s %12s %12s\n", "payload", "stored",
+           "pack MB/s", "unpack MB/s", "raw ops/s", "packed ops/s");
+
+    for (int kind = 0; kind < KINDS; kind++) {
+        fill(buf, PAYLOAD, kind);
+
+        int stored = 0;
+        double start = get_time();
+        for (int r = 0; r < rounds; r++) {
+            stored = rle_compress(buf, PAYLOAD, packed, RLE_BOUND(PAYLOAD));
+        }
+        double pack = get_time() - start;
+
+        if (stored == -1) {
+            fprintf(stderr, "%s payload overflows RLE_BOUND\n", kind_names[kind]);
+            exit(1);
+        }
+        start = get_time();
+        for (int r = 0; r < rounds; r++) {
+            if (rle_expand(packed, stored, expanded, PAYLOAD) != PAYLOAD) {
+                fprintf(stderr, "%s payload does not expand\n", kind_names[kind]);
+                exit(1);
+            }
+        }
+        double unpack = get_time() - start;
+        if (memcmp(buf, expanded, PAYLOAD) != 0) {
+            fprintf(stderr, "%s payload changed in a round trip\n",
+                    kind_names[kind]);
+            exit(1);
+        }
+
+        // Create and delete the same file over and over, so the writes land
+        // in the page cache and the cost is the copy and the compression
+        double ops[2];
+        for (int mode = 0; mode < 2; mode++) {
+            FS *fs;
+            if (init_fs(image, &fs) != SIMFS_OK) {
+                perror(image);
+                exit(1);
+            }
+            fs->compress = mode;
+            start = get_time();
+            for (int r = 0; r < rounds; r++) {
+                if (create_file(fs, "bench", PAYLOAD, buf) != SIMFS_OK ||
+                        delete_file(fs, "bench") != SIMFS_OK) {
+                    fprintf(stderr, "create/delete failed\n");
+                    exit(1);
+                }
+            }
+            ops[mode] = rounds / (get_time() - start);
+            if (close_fs(fs) != SIMFS_OK) {
+                perror(image);
+                exit(1);
+            }
+        }
+
+        double mb = (double) PAYLOAD * rounds / 1e6;
+        printf("%-8s %7d %12.1f %12.1f %12.0f %12.0f\n", kind_names[kind],
+               stored, mb / pack, mb / unpack, ops[0], ops[1]);
+    }
+
+    unlink(image);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <string.h>
+#include "compress.h"
+
+#define MAXRUN 128  // The longest literal or repeat one header byte covers
+#define MINRUN 3    // Shorter repeats are cheaper to leave in a literal
+
+/* Return the number of times the byte at src[i] repeats from i on,
+ * up to MAXRUN.
+ */
+static int run_length(const char *src, int n, int i) {
+    int run = 1;
+    while (i + run < n && run < MAXRUN && src[i + run] == src[i]) {
+        run++;
+    }
+    return run;
+}
+
+int rle_compress(const char *src, int n, char *dst, int cap) {
+    int i = 0;
+    int out = 0;
+
+    while (i < n) {
+        int run = run_length(src, n, i);
+
+        if (run >= MINRUN) {
+            if (out + 2 > cap) {
+                return -1;
+            }
+            dst[out++] = (signed char) (1 - run);
+            dst[out++] = src[i];
+            i += run;
+        } else {
+            // Gather bytes up to the start of the next repeat worth encoding
+            int start = i;
+            while (i < n && i - start < MAXRUN &&
+                    (i == start || run_length(src, n, i) < MINRUN)) {
+                i++;
+            }
+            if (out + 1 + (i - start) > cap) {
+                return -1;
+            }
+            dst[out++] = (signed char) (i - start - 1);
+            memcpy(dst + out, src + start, i - start);
+            out += i - start;
+        }
+    }
+    return out;
+}
+
+int rle_expand(const char *src, int n, char *dst, int cap) {
+    int i = 0;
+    int out = 0;
+
+    while (i < n) {
+        int header = (signed char) src[i++];
+
+        if (header >= 0) {
+            int len = header + 1;
+            if (i + len > n || out + len > cap) {
+                return -1;
+            }
+            memcpy(dst + out, src + i, len);
+            i += len;
+            out += len;
+        } else {
+            int len = 1 - header;
+            if (header == -MAXRUN || i >= n || out + len > cap) {
+                return -1;
+            }
+            memset(dst + out, src[i++], len);
+            out += len;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,25 @@
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+/* A run-length codec for file data, in the PackBits format: each header
+ * byte h is followed either by h + 1 literal bytes (h from 0 to 127), or by
+ * a single byte repeated 1 - h times (h from -1 to -127).
+ */
+
+/* The most space n bytes can take once compressed: one header byte for
+ * every literal of 128 bytes.
+ */
+#define RLE_BOUND(n) ((n) + ((n) + 127) / 128)
+
+/* Compress the n bytes at src into dst, which has room for cap bytes.
+ * Return the compressed length, or -1 if it would not fit in cap bytes.
+ */
+int rle_compress(const char *src, int n, char *dst, int cap);
+
+/* Expand the n compressed bytes at src into dst, which has room for cap
+ * bytes. Return the expanded length, or -1 if it would not fit or src is
+ * not valid compressed data.
+ */
+int rle_expand(const char *src, int n, char *dst, int cap);
+
+#endif /* COMPRESS_H_ */
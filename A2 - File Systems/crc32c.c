@@ -0,0 +1,68 @@
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82F63B78  // The Castagnoli polynomial, bit reversed
+
+static unsigned int table[256];
+static int use_sse42 = 0;
+
+/* Fill in the table for the software version and pick the version to use,
+ * before main runs so that threads can call crc32c() right away.
+ */
+__attribute__((constructor))
+static void crc32c_init() {
+    unsigned int i, bit;
+    for (i = 0; i < 256; i++) {
+        unsigned int crc = i;
+        for (bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        table[i] = crc;
+    }
+#if defined(__x86_64__)
+    use_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static unsigned int crc32c_sw(unsigned int crc, const unsigned char *p,
+                              size_t n) {
+    while (n > 0) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42(unsigned int crc, const unsigned char *p,
+                                 size_t n) {
+    unsigned long long c = crc;
+    while (n >= 8) {
+        unsigned long long word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        n -= 8;
+    }
+    while (n > 0) {
+        c = _mm_crc32_u8(c, *p++);
+        n--;
+    }
+    return c;
+}
+#endif
+
+unsigned int crc32c(unsigned int crc, const void *buf, size_t n) {
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (use_sse42) {
+        return ~crc32c_sse42(crc, buf, n);
+    }
+#endif
+    return ~crc32c_sw(crc, buf, n);
+}
@@ -0,0 +1,12 @@
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+
+/* Return the CRC32C (Castagnoli) of the n bytes at buf, continuing from crc,
+ * which is 0 for the first block. Uses the SSE4.2 crc32 instruction when
+ * the processor has it.
+ */
+unsigned int crc32c(unsigned int crc, const void *buf, size_t n);
+
+#endif /* CRC32C_H_ */
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "async_io.h"
+
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+/* Return the 64-bit FNV-1a hash of the n bytes in buf.
+ */
+unsigned long hash_data(const char *buf, int n) {
+    unsigned long hash = FNV_OFFSET;
+    int i;
+    for (i = 0; i < n; i++) {
+        hash ^= (unsigned char) buf[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Read the n bytes at offset in the simulated file system into buf.
+ */
+static int read_data(FS *fs, int offset, int n, char *buf) {
+    // data queued in this batch is not in the image yet
+    const char *queued = fs->aio != NULL ? aio_queued(fs, offset, n) : NULL;
+    if (queued != NULL) {
+        memcpy(buf, queued, n);
+        return SIMFS_OK;
+    }
+    if (fseek(fs->fp, offset, SEEK_SET) == -1 ||
+            fread(buf, 1, n, fs->fp) < n) {
+        return SIMFS_EIO;
+    }
+    return SIMFS_OK;
+}
+
+int dedup_find(FS *fs, const char *data, int n, unsigned long *hash,
+               int *entry) {
+    int i;
+    *hash = hash_data(data, n);
+    *entry = -1;
+
+    for (i = 0; i < MAXFILES; i++) {
+        Extent *e = &fs->extents[i];
+        if (e->refs > 0 && e->hash == *hash && e->stored == n) {
+            // Compare the bytes too, since different data can share a hash
+            char *buf = malloc(n);
+            if (buf == NULL) {
+                return SIMFS_ENOMEM;
+            }
+            int error = read_data(fs, e->offset, n, buf);
+            int same = error == SIMFS_OK && memcmp(buf, data, n) == 0;
+            free(buf);
+            if (error != SIMFS_OK) {
+                return error;
+            }
+            if (same) {
+                *entry = i;
+                return SIMFS_OK;
+            }
+        }
+    }
+    return SIMFS_OK;
+}
+
+void dedup_add(FS *fs, unsigned long hash, int offset, int n) {
+    int i;
+    for (i = 0; i < MAXFILES; i++) {
+        if (fs->extents[i].refs == 0) {
+            fs->extents[i].hash = hash;
+            fs->extents[i].offset = offset;
+            fs->extents[i].stored = n;
+            fs->extents[i].refs = 1;
+            return;
+        }
+    }
+    // Every live file has at most one entry, so a slot is always free
+}
+
+int dedup_release(FS *fs, int offset, int n) {
+    int i;
+    for (i = 0; i < MAXFILES; i++) {
+        Extent *e = &fs->extents[i];
+        if (e->refs > 0 && e->offset == offset && e->stored == n) {
+            e->refs--;
+            return e->refs;
+        }
+    }
+    return -1;
+}
+
+int dedup_rebuild(FS *fs) {
+    int i, j;
+    for (i = 0; i < MAXFILES; i++) {
+        fs->extents[i].refs = 0;
+    }
+
+    for (i = 0; i < MAXFILES; i++) {
+        Fnode *f = &fs->metadata[i];
+        if (f->offset < 0 || f->stored <= 0) {
+            continue;
+        }
+
+        // Files already sharing a block share its entry
+        for (j = 0; j < MAXFILES; j++) {
+            Extent *e = &fs->extents[j];
+            if (e->refs > 0 && e->offset == f->offset &&
+                    e->stored == f->stored) {
+                e->refs++;
+                break;
+            }
+        }
+        if (j < MAXFILES) {
+            continue;
+        }
+
+        char *buf = malloc(f->stored);
+        if (buf == NULL) {
+            return SIMFS_ENOMEM;
+        }
+        int error = read_data(fs, f->offset, f->stored, buf);
+        if (error != SIMFS_OK) {
+            free(buf);
+            return error;
+        }
+        dedup_add(fs, hash_data(buf, f->stored), f->offset, f->stored);
+        free(buf);
+    }
+    return SIMFS_OK;
+}
+
+int set_dedup(FS *fs, int on) {
+    fs->dedup = on;
+    if (on) {
+        // Files created before count too, so new ones can share their data
+        int error = dedup_rebuild(fs);
+        if (error != SIMFS_OK) {
+            fs->dedup = 0;
+        }
+        return error;
+    }
+    return SIMFS_OK;
+}
@@ -0,0 +1,33 @@
+#ifndef DEDUP_H_
+#define DEDUP_H_
+
+#include "file_ops.h"
+
+/* Deduplication of file data. While it is on, the data blocks of the live
+ * files are indexed by a hash of their stored bytes, so a new file whose
+ * data is already stored can share the block instead of taking new space.
+ */
+
+unsigned long hash_data(const char *buf, int n);
+
+/* Store in *entry the index entry of a block holding exactly the n bytes
+ * at data, or -1 if there is none. The hash of data is stored in *hash.
+ */
+int dedup_find(FS *fs, const char *data, int n, unsigned long *hash,
+               int *entry);
+
+/* Index a new block of n bytes at offset, with one reference. */
+void dedup_add(FS *fs, unsigned long hash, int offset, int n);
+
+/* Drop a reference to the block of n bytes at offset. Return the number
+ * of live files still sharing it, or -1 if it is not indexed.
+ */
+int dedup_release(FS *fs, int offset, int n);
+
+/* Rebuild the index from the data of the live files. */
+int dedup_rebuild(FS *fs);
+
+/* Turn deduplication of new files on or off. */
+int set_dedup(FS *fs, int on);
+
+#endif /* DEDUP_H_ */
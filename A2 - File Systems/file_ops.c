@@ -2,52 +2,75 @@
 #include <string.h>
 #include "file_ops.h"
 #include "free_list.h"
+#include "compress.h"
+#include "dedup.h"
+#include "crc32c.h"
+#include "async_io.h"
 
 /* You must not modify code already existing in this file. Your
  * code must interact with the reference implementation provided
  * here without requiring any changes to it */
 
-/* Return a pointer to the array of Fnodes that is read from the simulated
- * file system.
- * Notes:
- *  - The caller of this function must remember to free the memory that
- *    is returned.
- *  - The function is static because it is used only by other functions
- *    in this file.
+/* Read the array of Fnodes from the simulated file system into
+ * fs->metadata, and check it against its checksum.
+ * The function is static because it is used only by other functions
+ * in this file.
  */
-static Fnode *read_metadata(FS *fs) {
+static int read_metadata(FS *fs) {
     size_t numread;
     if (fseek(fs->fp, 0, SEEK_SET) == -1) {
-        perror("read_metadata:");
-        exit(1);
+        return SIMFS_EIO;
     }
     numread = fread(fs->metadata, sizeof(Fnode), MAXFILES, fs->fp);
     if (numread < MAXFILES) {
-        perror("read_metadata:");
-        exit(1);
+        return SIMFS_EIO;
+    }
+
+    unsigned int crc;
+    if (fread(&crc, sizeof(crc), 1, fs->fp) < 1) {
+        return SIMFS_EIO;
+    }
+    if (crc != crc32c(0, fs->metadata, sizeof(fs->metadata))) {
+        return SIMFS_ECORRUPT;
     }
-    return fs->metadata;
+    return SIMFS_OK;
 }
 
 /* Write the array of Fnodes to the simulated file system.
  */
-static void write_metadata(FS *fs) {
+static int write_metadata(FS *fs) {
     size_t numwritten;
     if (fseek(fs->fp, 0, SEEK_SET) == -1) {
-        perror("write_metadata:");
-        exit(1);
+        return SIMFS_EIO;
     }
     numwritten = fwrite(fs->metadata, sizeof(Fnode), MAXFILES, fs->fp);
     if (numwritten < MAXFILES) {
-        perror("write_metadata:");
-        exit(1);
+        return SIMFS_EIO;
+    }
+
+    unsigned int crc = crc32c(0, fs->metadata, sizeof(fs->metadata));
+    if (fwrite(&crc, sizeof(crc), 1, fs->fp) < 1) {
+        return SIMFS_EIO;
     }
+    return SIMFS_OK;
 }
 
+/* Write the metadata after a change, or only note that it changed while
+ * a batch of changes is under way.
+ */
+static int update_metadata(FS *fs) {
+    if (fs->batch) {
+        fs->dirty = 1;
+        return SIMFS_OK;
+    }
+    return write_metadata(fs);
+}
+
+
 /* Return the index into the metadata array for the Fnode that contains
  * the file named filename.  Return -1 if the file is not found.
  */
-static int find_fnode(Fnode *metadata, char *filename) {
+static int find_fnode(Fnode *metadata, const char *filename) {
     int i;
     for (i = 0; i < MAXFILES; i++) {
         if ((strcmp(metadata[i].name, filename)) == 0) {
@@ -57,79 +80,235 @@ static int find_fnode(Fnode *metadata, char *filename) {
     return -1;
 }
 
+/* Return the index of the snapshot named name, or -1 if there is none.
+ */
+static int find_snapshot(FS *fs, const char *name) {
+    int i;
+    for (i = 0; i < MAXSNAPSHOTS; i++) {
+        if (fs->snapshots[i].name[0] != '\0' &&
+                strcmp(fs->snapshots[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Mark every snapshot slot as unused.
+ */
+static void clear_snapshots(FS *fs) {
+    int i;
+    for (i = 0; i < MAXSNAPSHOTS; i++) {
+        fs->snapshots[i].name[0] = '\0';
+    }
+}
+
+/* Mark the Fnode f as unused.
+ */
+static void clear_fnode(Fnode *f) {
+    f->name[0] = '\0';
+    f->offset = -1;
+    f->length = -1;
+    f->stored = -1;
+    f->crc = 0;
+}
+
+/* Return 1 if one of the first count files of metadata takes exactly length
+ * bytes at offset.
+ */
+static int names_extent(Fnode *metadata, int count, int offset, int length) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (metadata[i].offset == offset && metadata[i].stored == length) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Return 1 if the block at offset and length still holds the data of a file
+ * in the live file system or in any snapshot, and so must not be freed.
+ */
+static int extent_in_use(FS *fs, int offset, int length) {
+    int i;
+    if (names_extent(fs->metadata, MAXFILES, offset, length)) {
+        return 1;
+    }
+    for (i = 0; i < MAXSNAPSHOTS; i++) {
+        if (fs->snapshots[i].name[0] != '\0' &&
+                names_extent(fs->snapshots[i].metadata, MAXFILES, offset,
+                             length)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Return the blocks of the files in metadata that nothing else refers to
+ * any more to the free list. A block shared by several of those files is
+ * returned only for the first of them.
+ */
+static void release_unused(FS *fs, Fnode *metadata) {
+    int i;
+    for (i = 0; i < MAXFILES; i++) {
+        if (metadata[i].offset >= 0 &&
+                !names_extent(metadata, i, metadata[i].offset,
+                              metadata[i].stored) &&
+                !extent_in_use(fs, metadata[i].offset, metadata[i].stored)) {
+            add_free_block(fs, metadata[i].offset, metadata[i].stored);
+        }
+    }
+}
+
+/* Forget the files whose data could not be written to the n bytes at
+ * offset, and free the block.
+ */
+static void drop_extent(FS *fs, int offset, int n) {
+    int i;
+    for (i = 0; i < MAXFILES; i++) {
+        if (fs->metadata[i].offset == offset && fs->metadata[i].stored == n) {
+            clear_fnode(&fs->metadata[i]);
+            fs->dirty = 1;
+        }
+    }
+    if (!extent_in_use(fs, offset, n)) {
+        add_free_block(fs, offset, n);
+    }
+}
+
+/* Start a batch of changes, during which the metadata is not written, and
+ * the data of new files is only queued if writes are asynchronous.
+ */
+void begin_batch(FS *fs) {
+    fs->batch = 1;
+    fs->dirty = 0;
+}
+
+/* End a batch of changes: write the queued data, and then the metadata if
+ * any of the changes touched it, so that it never names missing data.
+ */
+int end_batch(FS *fs) {
+    int error = SIMFS_OK;
+    fs->batch = 0;
+    if (fs->aio != NULL) {
+        error = aio_flush(fs, drop_extent);
+        if (error != SIMFS_OK && fs->dedup) {
+            dedup_rebuild(fs);
+        }
+    }
+    if (fs->dirty) {
+        fs->dirty = 0;
+        int write_error = write_metadata(fs);
+        if (error == SIMFS_OK) {
+            error = write_error;
+        }
+    }
+    return error;
+}
+
+/* Set up the in-memory state that is not stored in the image.
+ */
+static void init_state(FS *fs) {
+    fs->freelist = NULL;
+    clear_snapshots(fs);
+    fs->compress = 0;
+    fs->dedup = 0;
+    fs->batch = 0;
+    fs->dirty = 0;
+    fs->aio = NULL;
+}
+
 /* Initialize the simulated file system by writing the metadata to the file 
- * indicating that the file system is empty.
+ * indicating that the file system is empty, and store it in *fsp.
  */
-FS *init_fs(char *filename) {
+int init_fs(const char *filename, FS **fsp) {
     int i;
     char buf[MAX_FS_SIZE]; // Used to store the file system data in memory.
 
     FS *fs = malloc(sizeof(FS));
     if (fs == NULL) {
-        perror("init_fs:");
-        exit(1);
+        return SIMFS_ENOMEM;
     } 
 
     // open the file that will hold the file system data
     fs->fp = fopen(filename, "w+");
     if (fs->fp == NULL) {
-        perror("init_fs:");
-        exit(1);
+        free(fs);
+        return SIMFS_EIO;
     }
+    init_state(fs);
 
     // Initialize the metadata array and write it to the file
     for (i = 0; i < MAXFILES; i++) {
         fs->metadata[i].name[0] = '\0'; //Give the name an empty string
         fs->metadata[i].offset = -1; // Initialize to an invalid offset
         fs->metadata[i].length = -1; // Initialize to an invalid length
+        fs->metadata[i].stored = -1;
+        fs->metadata[i].crc = 0;
     }
-    write_metadata(fs);
 
     // Fill up the data area with . so that the real file has the correct size
     memset(buf, '.', MAX_FS_SIZE);  
-    if (fwrite(buf, MAX_FS_SIZE, 1, fs->fp) < 1) {
-        perror("init_fs:");
-        exit(1);
+    if (write_metadata(fs) != SIMFS_OK ||
+            fwrite(buf, MAX_FS_SIZE, 1, fs->fp) < 1) {
+        fclose(fs->fp);
+        free(fs);
+        return SIMFS_EIO;
     }
 
     // Initialize the free list
-    fs->freelist = NULL;
     add_free_block(fs, METADATA_ENDS, MAX_FS_SIZE);
 
-    return fs;
+    *fsp = fs;
+    return SIMFS_OK;
 }
 
 /* Opens an existing real file containing a file_system
- * and returns a properly initialized metadata struct
+ * and stores a properly initialized metadata struct in *fsp.
  */
-FS *open_fs(char *filename) {
+int open_fs(const char *filename, FS **fsp) {
     FS *fs = malloc(sizeof(FS));
     if (fs == NULL) {
-        perror("open_fs:");
-        exit(1);
+        return SIMFS_ENOMEM;
     } 
 
     fs->fp = fopen(filename, "r+");
     if (fs->fp == NULL) {
-        perror("open_fs:");
-        exit(1);
+        free(fs);
+        return SIMFS_EIO;
     }
+    init_state(fs);
     
-    read_metadata(fs);
+    int error = read_metadata(fs);
+    if (error != SIMFS_OK) {
+        fclose(fs->fp);
+        free(fs);
+        return error;
+    }
     
     /* Implement rebuild_freelist, and uncomment the next 
      * line when you are ready to test it.
      */
     rebuild_freelist(fs);
-    return fs;
+    *fsp = fs;
+    return SIMFS_OK;
 }
 
 /* Writes out the current state of the file system
- * and discards the in-memory state.
+ * and discards the in-memory state, even if writing fails.
  */
-void close_fs(FS *fs) {
-    write_metadata(fs);
-    fclose(fs->fp);
+int close_fs(FS *fs) {
+    int error = SIMFS_OK;
+    if (fs->aio != NULL) {
+        error = end_batch(fs);
+        aio_stop(fs);
+    }
+    int write_error = write_metadata(fs);
+    if (error == SIMFS_OK) {
+        error = write_error;
+    }
+    if (fclose(fs->fp) != 0 && error == SIMFS_OK) {
+        error = SIMFS_EIO;
+    }
     
     /* Memory needs to be freed before exiting. Write the code
      * to do this
@@ -143,7 +322,7 @@ void close_fs(FS *fs) {
         curr = next;        
     }
     free(fs);
-
+    return error;
 }
 
 /* Print the contents of the simulated file system to stdout.
@@ -157,8 +336,13 @@ void print_fs(FS *fs) {
     printf("Metadata:\n");
 
     for (i = 0; i < MAXFILES; i++) {
-        printf("%d %-24s %d %d\n", i, fs->metadata[i].name, 
+        printf("%d %-24s %d %d", i, fs->metadata[i].name, 
                 fs->metadata[i].offset, fs->metadata[i].length);
+        // Compressed files also show the space they take
+        if (fs->metadata[i].stored < fs->metadata[i].length) {
+            printf(" (%d stored)", fs->metadata[i].stored);
+        }
+        printf("\n");
     }
     printf("\n");
 
@@ -178,21 +362,29 @@ void print_fs(FS *fs) {
 
 /* Initialize metadata for a file. No space allocated to it yet
  */
-void create_file(FS *fs, char *filename, int size, char *buf) {
+int create_file(FS *fs, const char *filename, int size, const char *buf) {
     int i;
+
+    // A second file of the same name could never be read or deleted.
+    char name[MAXNAME];
+    strncpy(name, filename, MAXNAME);
+    name[MAXNAME-1] = '\0';
+    if (name[0] != '\0' && find_fnode(fs->metadata, name) != -1) {
+        return SIMFS_EEXIST;
+    }
     for (i = 0; i < MAXFILES; i++) {
         if (fs->metadata[i].offset < 0) {
             fs->metadata[i].offset = 0;
             fs->metadata[i].length = 0;
+            fs->metadata[i].stored = 0;
+            fs->metadata[i].crc = 0;
             strncpy(fs->metadata[i].name, filename, MAXNAME);
             fs->metadata[i].name[MAXNAME-1] = '\0';
             break;
         }
     }
     if(i == MAXFILES) {
-        fprintf(stderr, "Error: too many files.  Could not create %s\n", 
-                filename);
-        return;
+        return SIMFS_ETOOMANY;
     }
 
     /* Complete this function to
@@ -201,49 +393,214 @@ void create_file(FS *fs, char *filename, int size, char *buf) {
         (tip: use fwrite)
         - updates the offset in the metadata
      */
+    // in compressed mode, keep the compressed data if it is any smaller
+    const char *data = buf;
+    int stored = size;
+    char *packed = NULL;
+    if (fs->compress && size > 0) {
+        packed = malloc(size);
+        if (packed == NULL) {
+            clear_fnode(&fs->metadata[i]);
+            return SIMFS_ENOMEM;
+        }
+        int packed_size = rle_compress(buf, size, packed, size - 1);
+        if (packed_size != -1) {
+            data = packed;
+            stored = packed_size;
+        }
+    }
+
+    unsigned int crc = crc32c(0, data, stored);
+
+    // in dedup mode, share the block of a file with the same stored data
+    unsigned long hash = 0;
+    if (fs->dedup && stored > 0) {
+        int shared;
+        int error = dedup_find(fs, data, stored, &hash, &shared);
+        if (error != SIMFS_OK) {
+            clear_fnode(&fs->metadata[i]);
+            free(packed);
+            return error;
+        }
+        if (shared != -1) {
+            fs->extents[shared].refs++;
+            free(packed);
+            fs->metadata[i].offset = fs->extents[shared].offset;
+            fs->metadata[i].length = size;
+            fs->metadata[i].stored = stored;
+            fs->metadata[i].crc = crc;
+            return update_metadata(fs);
+        }
+    }
+
     // find suitable block
-    int offset = get_free_block(fs, size);
+    int offset = get_free_block(fs, stored);
 
     // if there is no space, clear metadata
     if (offset == -1) {
-        fprintf(stderr, "Error: no space. Could not create %s\n", filename);
-        fs->metadata[i].name[0] = '\0';
-        fs->metadata[i].offset = -1;
-        fs->metadata[i].length = -1;
-        return;
+        clear_fnode(&fs->metadata[i]);
+        free(packed);
+        return SIMFS_ENOSPC;
     }
 
-    // writes the simulated data to the real file at the offset
-    fseek(fs->fp, offset, SEEK_SET);
-    fwrite(buf, sizeof(char), size, fs->fp);
+    // writes the simulated data to the real file at the offset, or queues
+    // it to go with the rest of the batch
+    int error = SIMFS_OK;
+    if (fs->aio != NULL && fs->batch) {
+        if (stored > 0) {
+            error = aio_queue(fs, offset, data, stored);
+        }
+    } else if (fseek(fs->fp, offset, SEEK_SET) == -1 ||
+            fwrite(data, sizeof(char), stored, fs->fp) < stored) {
+        error = SIMFS_EIO;
+    }
+    if (error != SIMFS_OK) {
+        clear_fnode(&fs->metadata[i]);
+        add_free_block(fs, offset, stored);
+        free(packed);
+        return error;
+    }
+    free(packed);
+    if (fs->dedup && stored > 0) {
+        dedup_add(fs, hash, offset, stored);
+    }
     // updates offset in metadata
     fs->metadata[i].offset = offset;
     fs->metadata[i].length = size;
-    write_metadata(fs);
+    fs->metadata[i].stored = stored;
+    fs->metadata[i].crc = crc;
+    return update_metadata(fs);
+}
+
+/* Read the data of the file named filename into buf, which has room for
+ * cap bytes, and return its length.
+ */
+int read_file(FS *fs, const char *filename, char *buf, int cap) {
+    int index = find_fnode(fs->metadata, filename);
+    if (index == -1) {
+        return SIMFS_ENOENT;
+    }
+
+    Fnode *f = &fs->metadata[index];
+    if (f->length > cap) {
+        return SIMFS_EINVAL;
+    }
+
+    // compressed data is read into a buffer of its own and expanded
+    char *data = buf;
+    if (f->stored < f->length) {
+        data = malloc(f->stored);
+        if (data == NULL) {
+            return SIMFS_ENOMEM;
+        }
+    }
+
+    int error = SIMFS_OK;
+    if (fseek(fs->fp, f->offset, SEEK_SET) == -1 ||
+            fread(data, 1, f->stored, fs->fp) < f->stored) {
+        error = SIMFS_EIO;
+    } else if (crc32c(0, data, f->stored) != f->crc) {
+        error = SIMFS_ECORRUPT;
+    } else if (data != buf &&
+            rle_expand(data, f->stored, buf, cap) != f->length) {
+        error = SIMFS_ECORRUPT;
+    }
+
+    if (data != buf) {
+        free(data);
+    }
+    return error == SIMFS_OK ? f->length : error;
 }
 
 /* Remove metadata for this file, and return allocated space to free list.
  * This function does not delete the file data, it only modifies the 
  * Fnode and the free list.
  */
-void delete_file(FS *fs, char *filename) {
+int delete_file(FS *fs, const char *filename) {
     int index = find_fnode(fs->metadata, filename);
 
     if (index == -1) {
-        fprintf(stderr, "Error: file %s does not exist\n", filename);
-        return;
+        return SIMFS_ENOENT;
     }
 
     /* Give back the free space to the freelist */
     int file_offset = fs->metadata[index].offset;
-    int file_length = fs->metadata[index].length;
-
-    // account for deletion in freelist 
-    add_free_block(fs, file_offset, file_length);
+    int file_length = fs->metadata[index].stored;
 
     // Update the metadata
-    fs->metadata[index].name[0] = '\0';
-    fs->metadata[index].offset = -1;
-    fs->metadata[index].length = -1;
-    write_metadata(fs);
+    clear_fnode(&fs->metadata[index]);
+    int error = update_metadata(fs);
+
+    // account for deletion in freelist, unless another file shares the
+    // data or a snapshot still has it
+    if (fs->dedup && dedup_release(fs, file_offset, file_length) > 0) {
+        return error;
+    }
+    if (!extent_in_use(fs, file_offset, file_length)) {
+        add_free_block(fs, file_offset, file_length);
+    }
+    return error;
+}
+
+/* Record the current metadata as the snapshot called name. Only the
+ * metadata is copied, so this takes the same time whatever the size of the
+ * files: the data blocks are shared until the live file system deletes them.
+ */
+int take_snapshot(FS *fs, const char *name) {
+    int i;
+    if (find_snapshot(fs, name) != -1) {
+        return SIMFS_EEXIST;
+    }
+    for (i = 0; i < MAXSNAPSHOTS; i++) {
+        if (fs->snapshots[i].name[0] == '\0') {
+            break;
+        }
+    }
+    if (i == MAXSNAPSHOTS) {
+        return SIMFS_ETOOMANY;
+    }
+
+    strncpy(fs->snapshots[i].name, name, MAXNAME);
+    fs->snapshots[i].name[MAXNAME-1] = '\0';
+    memcpy(fs->snapshots[i].metadata, fs->metadata, sizeof(fs->metadata));
+    return SIMFS_OK;
+}
+
+/* Roll the file system back to the snapshot called name. Files created
+ * since the snapshot lose their space unless another snapshot has them;
+ * files deleted since come back with the data the snapshot kept for them.
+ * The snapshot is kept, so the file system can be rolled back to it again.
+ */
+int restore_snapshot(FS *fs, const char *name) {
+    int index = find_snapshot(fs, name);
+    Fnode old[MAXFILES];
+
+    if (index == -1) {
+        return SIMFS_ENOENT;
+    }
+
+    memcpy(old, fs->metadata, sizeof(fs->metadata));
+    memcpy(fs->metadata, fs->snapshots[index].metadata, sizeof(fs->metadata));
+    int error = update_metadata(fs);
+    release_unused(fs, old);
+    if (fs->dedup && error == SIMFS_OK) {
+        error = dedup_rebuild(fs);
+    }
+    return error;
+}
+
+/* Forget the snapshot called name, freeing the blocks only it referred to.
+ */
+int drop_snapshot(FS *fs, const char *name) {
+    int index = find_snapshot(fs, name);
+    Fnode old[MAXFILES];
+
+    if (index == -1) {
+        return SIMFS_ENOENT;
+    }
+
+    memcpy(old, fs->snapshots[index].metadata, sizeof(old));
+    fs->snapshots[index].name[0] = '\0';
+    release_unused(fs, old);
+    return SIMFS_OK;
 }
@@ -5,17 +5,22 @@
  * must be implemented by you. You may not change other parts of this file.*/
 
 #include <stdio.h>
+#include "simfs.h"
 
 #define MAXNAME 24  // The maximum length allowed for a file name
 #define MAXFILES 16
 #define READSIZE 64
 #define MAX_FS_SIZE 1024
-#define METADATA_ENDS (int)(sizeof(Fnode) * MAXFILES)   // 
+// The Fnodes are followed by the CRC32C of the whole array
+#define METADATA_ENDS (int)(sizeof(Fnode) * MAXFILES + sizeof(unsigned int))
+#define MAXSNAPSHOTS 4
 
 typedef struct fnode {
     char name[MAXNAME];
     int offset;
-    int length;
+    int length;     // The length of the file's data
+    int stored;     // The space it takes, less than length if compressed
+    unsigned int crc;   // The CRC32C of the stored data
 } Fnode;
 
 typedef struct freeblock {
@@ -26,23 +31,64 @@ typedef struct freeblock {
      * (Our solution had no additional fields)*/
 } Freeblock;
 
+/* An entry of the deduplication index: a block of data in the file system,
+ * found by the hash of its stored bytes, and the number of live files that
+ * share it. An entry with no references is unused.
+ */
+typedef struct extent {
+    unsigned long hash;
+    int offset;
+    int stored;
+    int refs;
+} Extent;
+
+/* A snapshot is a copy of the metadata at the time it was taken. Files are
+ * never rewritten in place, so the snapshot shares the data blocks of every
+ * file it names with the live file system; those blocks are only returned
+ * to the free list once neither the live metadata nor any snapshot names
+ * them. Snapshots are kept in memory until the file system is closed.
+ */
+typedef struct snapshot {
+    char name[MAXNAME];         // An empty name marks an unused slot
+    Fnode metadata[MAXFILES];
+} Snapshot;
+
 typedef struct fs {
     Fnode metadata[MAXFILES];   // A place to store the meta data so we don't
                                 // need to keep reading it.
     Freeblock *freelist;        // A pointer to the linked list of free blocks
     FILE *fp;                   // The open file handle to the file containing
                                 // the simulated file system.
+    Snapshot snapshots[MAXSNAPSHOTS];
+    int compress;               // Whether new files are stored compressed
+    int dedup;                  // Whether new files share identical data
+    Extent extents[MAXFILES];   // The deduplication index, while dedup is on
+    int batch;                  // Whether metadata writes are held back
+    int dirty;                  // Whether the metadata changed meanwhile
+    struct async_io *aio;       // Queued data writes, or NULL to write
+                                // them synchronously
 } FS;
 
 
-FS *init_fs(char *filename);
-FS *open_fs(char *filename);
-void close_fs(FS *fs);
+/* The functions that can fail return SIMFS_OK or an error code from
+ * simfs.h, and leave reporting it to the caller.
+ */
+int init_fs(const char *filename, FS **fsp);
+int open_fs(const char *filename, FS **fsp);
+int close_fs(FS *fs);
 
 void print_fs(FS *fs);
-void create_file(FS *fs, char *filename, int size, char *buf);
-void delete_file(FS *fs, char *filename);
+int create_file(FS *fs, const char *filename, int size, const char *buf);
+int delete_file(FS *fs, const char *filename);
+int read_file(FS *fs, const char *filename, char *buf, int cap);
+
+void begin_batch(FS *fs);
+int end_batch(FS *fs);
 
 void fs_list(FS *fs);
 
+int take_snapshot(FS *fs, const char *name);
+int restore_snapshot(FS *fs, const char *name);
+int drop_snapshot(FS *fs, const char *name);
+
 #endif /*FILE_OPS_H_*/
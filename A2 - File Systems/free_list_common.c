@@ -12,7 +12,6 @@
  */
 void add_free_block(FS *fs, int location, int size) {
     Freeblock *curr = fs -> freelist;
-    Freeblock *next_block = curr -> next;
     Freeblock *order_block = NULL;
 
     // create the first free block when fs->freelist is NULL
@@ -26,6 +25,8 @@ void add_free_block(FS *fs, int location, int size) {
 
     // looking for adjacent blocks to merge with
     while (curr != NULL) {
+        Freeblock *next_block = curr->next;
+
         // Merge with adjacent block after curr block
         if (location + size == curr->offset) { //case 4, 0, 2
             curr->offset = location;
@@ -36,9 +37,10 @@ void add_free_block(FS *fs, int location, int size) {
             curr->length += size;
             // merge if there is another adjacent, since we merged with 
             // previous non-consecutive block
-            if(next_block -> offset == location + size){ // case 5
+            if (next_block != NULL && next_block->offset == location + size) { // case 5
                 curr->length += next_block->length;
                 curr->next = next_block->next;
+                free(next_block);
             }
             return;
         }
@@ -91,7 +93,7 @@ int rebuild_helper(const void *a, const void *b) {
 void rebuild_freelist(FS *fs) {
     Freeblock *prev = NULL;
     int data_start = METADATA_ENDS;
-    int data_end = MAX_FS_SIZE;
+    int data_end = METADATA_ENDS + MAX_FS_SIZE;
 
     // sort metadata for easier freelist building in order of location/offset
     qsort(fs->metadata, MAXFILES, sizeof(Fnode), rebuild_helper);
@@ -100,7 +102,12 @@ void rebuild_freelist(FS *fs) {
     int curr_offset = data_start;
     for (int i = 0; i < MAXFILES; i++) {
         int file_offset = fs->metadata[i].offset;
-        int file_length = fs->metadata[i].length;
+        int file_length = fs->metadata[i].stored;
+
+        // unused Fnodes sort first and take no space
+        if (file_offset < 0) {
+            continue;
+        }
 
         // add empty space to freelist
         if (curr_offset < file_offset) {
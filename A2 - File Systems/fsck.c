@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "file_ops.h"
+#include "free_list.h"
+#include "compress.h"
+#include "crc32c.h"
+
+/* Checks the image of a simulated file system: the checksum of the
+ * metadata, the names and extents of the files, overlaps between files that
+ * do not share their data, and the checksum of each file's data, which is
+ * read and checked by several threads at once. Then prints the free list
+ * that open_fs would rebuild from the files that passed.
+ *
+ * With -r, files that failed are removed from the metadata, which is
+ * written back with a new checksum, so the image can be opened again.
+ *
+ * Usage: fsck [-r] [-j threads] image
+ * Exits with 1 if any problem was found, repaired or not.
+ */
+
+#define DATA_ENDS (METADATA_ENDS + MAX_FS_SIZE)
+
+enum verdict {
+    GOOD,
+    BAD_CRC,        // The data does not match its checksum
+    BAD_PACKED,     // The compressed data does not expand to its length
+    BAD_READ        // The data could not be read
+};
+
+static char *verdict_names[] = {
+    "good", "data checksum mismatch", "bad compressed data", "unreadable data"
+};
+
+struct check {
+    int fd;
+    Fnode *metadata;
+    int *files;         // The files whose data is to be checked
+    int count;
+    int next;           // The next of files to take
+    enum verdict verdicts[MAXFILES];
+};
+
+static int problems = 0;
+
+static void problem(int index, char *name, char *what) {
+    printf("fsck: file %d (%s): %s\n", index, name, what);
+    problems++;
+}
+
+/* Check the data of the file f.
+ */
+static enum verdict check_file(int fd, Fnode *f) {
+    char *buf = malloc(f->stored);
+    if (buf == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    enum verdict verdict = GOOD;
+    if (pread(fd, buf, f->stored, f->offset) != f->stored) {
+        verdict = BAD_READ;
+    } else if (crc32c(0, buf, f->stored) != f->crc) {
+        verdict = BAD_CRC;
+    } else if (f->stored < f->length) {
+        char *expanded = malloc(f->length);
+        if (expanded == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        if (rle_expand(buf, f->stored, expanded, f->length) != f->length) {
+            verdict = BAD_PACKED;
+        }
+        free(expanded);
+    }
+    free(buf);
+    return verdict;
+}
+
+/* Take files to check until there are none left.
+ */
+static void *check_worker(void *arg) {
+    struct check *c = arg;
+    int n;
+    while ((n = __atomic_fetch_add(&c->next, 1, __ATOMIC_RELAXED)) < c->count) {
+        int i = c->files[n];
+        c->verdicts[i] = check_file(c->fd, &c->metadata[i]);
+    }
+    return NULL;
+}
+
+/* Check the data of the files listed in files with up to threads threads,
+ * but never more than there are files, and at least one.
+ */
+static void check_data(struct check *c, int threads) {
+    int t;
+
+    if (threads > c->count) {
+        threads = c->count;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    pthread_t tids[threads];
+    for (t = 0; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, check_worker, c) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+}
+
+// Helper for qsort, ordering indices into sort_metadata by offset
+static Fnode *sort_metadata;
+static int offset_order(const void *a, const void *b) {
+    Fnode *fa = &sort_metadata[*(int *) a];
+    Fnode *fb = &sort_metadata[*(int *) b];
+    if (fa->offset != fb->offset) {
+        return fa->offset - fb->offset;
+    }
+    return *(int *) a - *(int *) b;
+}
+
+/* Remove the file at metadata[i].
+ */
+static void drop(Fnode *metadata, int *bad, int i) {
+    bad[i] = 1;
+    memset(&metadata[i], 0, sizeof(Fnode));
+    metadata[i].offset = -1;
+    metadata[i].length = -1;
+    metadata[i].stored = -1;
+}
+
+int main(int argc, char *argv[]) {
+    int repair = 0;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "rj:")) != -1) {
+        if (opt == 'r') {
+            repair = 1;
+        } else if (opt == 'j' && (threads = strtol(optarg, NULL, 10)) > 0) {
+            continue;
+        } else {
+            fprintf(stderr, "Usage: %s [-r] [-j threads] image\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-r] [-j threads] image\n", argv[0]);
+        exit(1);
+    }
+    char *image = argv[optind];
+
+    int fd = open(image, repair ? O_RDWR : O_RDONLY);
+    if (fd == -1) {
+        perror(image);
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        exit(1);
+    }
+    if (st.st_size < METADATA_ENDS) {
+        printf("fsck: image is %ld bytes, too small for the metadata\n",
+               (long) st.st_size);
+        exit(1);
+    }
+    if (st.st_size != DATA_ENDS) {
+        printf("fsck: image is %ld bytes, expected %d\n", (long) st.st_size,
+               DATA_ENDS);
+        problems++;
+    }
+
+    Fnode metadata[MAXFILES];
+    unsigned int crc;
+    if (pread(fd, metadata, sizeof(metadata), 0) != sizeof(metadata) ||
+            pread(fd, &crc, sizeof(crc), sizeof(metadata)) != sizeof(crc)) {
+        perror("pread");
+        exit(1);
+    }
+    if (crc != crc32c(0, metadata, sizeof(metadata))) {
+        printf("fsck: metadata checksum mismatch\n");
+        problems++;
+    }
+
+    // Check each Fnode on its own
+    int bad[MAXFILES] = {0};
+    int files[MAXFILES];
+    int count = 0;
+    for (i = 0; i < MAXFILES; i++) {
+        Fnode *f = &metadata[i];
+        if (f->name[0] == '\0' && f->offset == -1) {
+            continue;   // An unused Fnode
+        }
+
+        if (memchr(f->name, '\0', MAXNAME) == NULL) {
+            f->name[MAXNAME - 1] = '\0';
+            problem(i, f->name, "name is not terminated");
+            drop(metadata, bad, i);
+        } else if (f->name[0] == '\0') {
+            problem(i, "", "file has no name");
+            drop(metadata, bad, i);
+        } else if (f->offset < METADATA_ENDS || f->stored < 0 ||
+                f->length < f->stored ||
+                f->offset + f->stored > DATA_ENDS ||
+                f->offset + f->stored > st.st_size) {
+            problem(i, f->name, "extent is out of range");
+            drop(metadata, bad, i);
+        } else {
+            int j;
+            for (j = 0; j < i; j++) {
+                if (!bad[j] && strcmp(metadata[j].name, f->name) == 0) {
+                    break;
+                }
+            }
+            if (j < i) {
+                problem(i, f->name, "name is used by an earlier file");
+                drop(metadata, bad, i);
+            } else if (f->stored > 0) {
+                files[count++] = i;
+            }
+        }
+    }
+
+    // Check the data of the rest in parallel
+    struct check c = {fd, metadata, files, count, 0, {GOOD}};
+    check_data(&c, threads);
+    int good = 0;
+    for (i = 0; i < count; i++) {
+        int f = files[i];
+        if (c.verdicts[f] != GOOD) {
+            problem(f, metadata[f].name, verdict_names[c.verdicts[f]]);
+            drop(metadata, bad, f);
+        } else {
+            files[good++] = f;
+        }
+    }
+
+    // Files may share a block only if they name exactly the same one
+    sort_metadata = metadata;
+    qsort(files, good, sizeof(int), offset_order);
+    int last = -1;
+    for (i = 0; i < good; i++) {
+        Fnode *f = &metadata[files[i]];
+        if (last != -1) {
+            Fnode *l = &metadata[last];
+            int shared = f->offset == l->offset && f->stored == l->stored &&
+                         f->crc == l->crc;
+            if (!shared && f->offset < l->offset + l->stored) {
+                char what[MAXNAME + 32];
+                snprintf(what, sizeof(what), "overlaps file %d (%s)",
+                         last, l->name);
+                problem(files[i], f->name, what);
+                drop(metadata, bad, files[i]);
+                continue;
+            }
+        }
+        last = files[i];
+    }
+
+    // The free list that the files that passed leave
+    FS fs;
+    memcpy(fs.metadata, metadata, sizeof(metadata));
+    fs.freelist = NULL;
+    rebuild_freelist(&fs);
+    print_freelist(&fs);
+    while (fs.freelist != NULL) {
+        Freeblock *next = fs.freelist->next;
+        free(fs.freelist);
+        fs.freelist = next;
+    }
+
+    int dropped = 0;
+    for (i = 0; i < MAXFILES; i++) {
+        dropped += bad[i];
+    }
+    if (repair && problems > 0) {
+        crc = crc32c(0, metadata, sizeof(metadata));
+        if (pwrite(fd, metadata, sizeof(metadata), 0) != sizeof(metadata) ||
+                pwrite(fd, &crc, sizeof(crc), sizeof(metadata)) != sizeof(crc)) {
+            perror("pwrite");
+            exit(1);
+        }
+        printf("fsck: repaired, %d files removed\n", dropped);
+    }
+    printf("fsck: %d problems\n", problems);
+
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+    return problems > 0;
+}
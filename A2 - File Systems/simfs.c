@@ -0,0 +1,171 @@
+#include <string.h>
+#include "simfs.h"
+#include "file_ops.h"
+#include "dedup.h"
+#include "async_io.h"
+
+/* The library entry points. They check their arguments, which the
+ * transaction files never need, and pass the rest on to file_ops.c.
+ */
+
+static const char *messages[] = {
+    "success",
+    "I/O error on the image",
+    "out of memory",
+    "no free block is large enough",
+    "too many files or snapshots",
+    "no such file or snapshot",
+    "file or snapshot already exists",
+    "metadata checksum mismatch",
+    "invalid argument"
+};
+
+const char *simfs_strerror(int error) {
+    if (error > 0 || error < SIMFS_EINVAL) {
+        return "unknown error";
+    }
+    return messages[-error];
+}
+
+/* Return 1 if name can name a file or snapshot without being cut short.
+ */
+static int valid_name(const char *name) {
+    return name != NULL && name[0] != '\0' && strlen(name) < MAXNAME;
+}
+
+int simfs_init(const char *image, SimFS **fs) {
+    if (image == NULL || fs == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return init_fs(image, fs);
+}
+
+int simfs_open(const char *image, SimFS **fs) {
+    if (image == NULL || fs == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return open_fs(image, fs);
+}
+
+int simfs_close(SimFS *fs) {
+    if (fs == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return close_fs(fs);
+}
+
+int simfs_create(SimFS *fs, const char *name, int size, const char *data) {
+    if (fs == NULL || !valid_name(name) || size < 0 ||
+            (data == NULL && size > 0)) {
+        return SIMFS_EINVAL;
+    }
+    return create_file(fs, name, size, data);
+}
+
+int simfs_delete(SimFS *fs, const char *name) {
+    if (fs == NULL || name == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return delete_file(fs, name);
+}
+
+int simfs_read(SimFS *fs, const char *name, char *buf, int cap) {
+    if (fs == NULL || name == NULL || buf == NULL || cap < 0) {
+        return SIMFS_EINVAL;
+    }
+    return read_file(fs, name, buf, cap);
+}
+
+int simfs_create_many(SimFS *fs, const SimFile *files, int n, int *errors) {
+    int i;
+    int created = 0;
+
+    if (fs == NULL || files == NULL || n < 0) {
+        return SIMFS_EINVAL;
+    }
+    begin_batch(fs);
+    for (i = 0; i < n; i++) {
+        int error = simfs_create(fs, files[i].name, files[i].size,
+                                 files[i].data);
+        if (errors != NULL) {
+            errors[i] = error;
+        }
+        created += error == SIMFS_OK;
+    }
+    int error = end_batch(fs);
+    return error == SIMFS_OK ? created : error;
+}
+
+int simfs_delete_many(SimFS *fs, const char *const *names, int n,
+                      int *errors) {
+    int i;
+    int deleted = 0;
+
+    if (fs == NULL || names == NULL || n < 0) {
+        return SIMFS_EINVAL;
+    }
+    begin_batch(fs);
+    for (i = 0; i < n; i++) {
+        int error = simfs_delete(fs, names[i]);
+        if (errors != NULL) {
+            errors[i] = error;
+        }
+        deleted += error == SIMFS_OK;
+    }
+    int error = end_batch(fs);
+    return error == SIMFS_OK ? deleted : error;
+}
+
+int simfs_set_compress(SimFS *fs, int on) {
+    if (fs == NULL) {
+        return SIMFS_EINVAL;
+    }
+    fs->compress = on != 0;
+    return SIMFS_OK;
+}
+
+int simfs_set_dedup(SimFS *fs, int on) {
+    if (fs == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return set_dedup(fs, on != 0);
+}
+
+int simfs_set_async(SimFS *fs, int mode) {
+    if (fs == NULL || mode < SIMFS_SYNC || mode > SIMFS_ASYNC_THREADS) {
+        return SIMFS_EINVAL;
+    }
+    if (mode == SIMFS_SYNC) {
+        aio_stop(fs);
+        return SIMFS_OK;
+    }
+    return aio_start(fs, mode == SIMFS_ASYNC);
+}
+
+const char *simfs_async_engine(SimFS *fs) {
+    if (fs == NULL || fs->aio == NULL) {
+        return "sync";
+    }
+    return aio_engine(fs);
+}
+
+int simfs_snapshot(SimFS *fs, const char *name) {
+    if (fs == NULL || !valid_name(name)) {
+        return SIMFS_EINVAL;
+    }
+    return take_snapshot(fs, name);
+}
+
+int simfs_restore(SimFS *fs, const char *name) {
+    if (fs == NULL || name == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return restore_snapshot(fs, name);
+}
+
+int simfs_drop_snapshot(SimFS *fs, const char *name) {
+    if (fs == NULL || name == NULL) {
+        return SIMFS_EINVAL;
+    }
+    return drop_snapshot(fs, name);
+}
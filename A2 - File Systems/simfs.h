@@ -0,0 +1,88 @@
+#ifndef SIMFS_H_
+#define SIMFS_H_
+
+/* libsimfs: the simulated file system as a library, for programs that drive
+ * it in-process instead of through transaction files.
+ *
+ * A file system is used through an opaque handle. No function prints or
+ * exits: each returns SIMFS_OK or one of the negative error codes below,
+ * which simfs_strerror() describes. After SIMFS_EIO, errno tells what the
+ * system call that failed reported.
+ */
+
+typedef struct fs SimFS;
+
+enum simfs_error {
+    SIMFS_OK = 0,
+    SIMFS_EIO = -1,         // Reading or writing the image failed
+    SIMFS_ENOMEM = -2,      // Out of memory
+    SIMFS_ENOSPC = -3,      // No free block is large enough
+    SIMFS_ETOOMANY = -4,    // Every Fnode or snapshot slot is in use
+    SIMFS_ENOENT = -5,      // No file or snapshot has that name
+    SIMFS_EEXIST = -6,      // A file or snapshot already has that name
+    SIMFS_ECORRUPT = -7,    // The image fails its checksum
+    SIMFS_EINVAL = -8       // An argument is out of range
+};
+
+// How simfs_set_async() writes file data
+enum simfs_async {
+    SIMFS_SYNC = 0,         // As each file is created
+    SIMFS_ASYNC = 1,        // A batch at a time, through an io_uring if the
+                            // kernel allows, or else through threads
+    SIMFS_ASYNC_THREADS = 2 // A batch at a time, through threads
+};
+
+// One file of a batch for simfs_create_many()
+typedef struct simfs_file {
+    const char *name;
+    int size;
+    const char *data;
+} SimFile;
+
+const char *simfs_strerror(int error);
+
+/* Create an empty file system in the file image, or open the one there,
+ * and store its handle in *fs. simfs_close() writes out the metadata and
+ * frees the handle, even if it fails.
+ */
+int simfs_init(const char *image, SimFS **fs);
+int simfs_open(const char *image, SimFS **fs);
+int simfs_close(SimFS *fs);
+
+/* Create the file name with the size bytes at data, or delete it. */
+int simfs_create(SimFS *fs, const char *name, int size, const char *data);
+int simfs_delete(SimFS *fs, const char *name);
+
+/* Read the file name into buf, which has room for cap bytes. Return its
+ * length, or an error code if it does not exist or does not fit.
+ */
+int simfs_read(SimFS *fs, const char *name, char *buf, int cap);
+
+/* Create or delete n files, writing the metadata out once for the whole
+ * batch. Files are handled in order and a failure does not stop the rest.
+ * If errors is not NULL, errors[i] is set to the result for file i.
+ * Return the number of files created or deleted, or SIMFS_EIO if the
+ * metadata could not be written.
+ */
+int simfs_create_many(SimFS *fs, const SimFile *files, int n, int *errors);
+int simfs_delete_many(SimFS *fs, const char *const *names, int n,
+                      int *errors);
+
+/* Store new files compressed, or share the data of identical new files. */
+int simfs_set_compress(SimFS *fs, int on);
+int simfs_set_dedup(SimFS *fs, int on);
+
+/* Choose how the data of the files in a batch is written, one of
+ * enum simfs_async. With either asynchronous mode the writes of a batch are
+ * submitted together, and its metadata is written once they have all
+ * finished. simfs_async_engine() names the mechanism in use.
+ */
+int simfs_set_async(SimFS *fs, int mode);
+const char *simfs_async_engine(SimFS *fs);
+
+/* Take, roll back to, or drop the snapshot name. */
+int simfs_snapshot(SimFS *fs, const char *name);
+int simfs_restore(SimFS *fs, const char *name);
+int simfs_drop_snapshot(SimFS *fs, const char *name);
+
+#endif /* SIMFS_H_ */
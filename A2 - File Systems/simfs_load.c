@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "simfs.h"
+
+/* A load generator that drives libsimfs in-process. Each round creates a
+ * batch of files, reads them back and checks them, then deletes them,
+ * first one call per file and then one call per batch.
+ *
+ * Usage: simfs_load [rounds [files [size]]]
+ */
+
+#define MAXBATCH 16     // The file system holds at most 16 files
+
+static double get_time() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Exit with a message if error is an error code.
+ */
+static void check(const char *what, int error) {
+    if (error < 0) {
+        fprintf(stderr, "%s: %s\n", what, simfs_strerror(error));
+        exit(1);
+    }
+}
+
+/* Read back each of the n files and compare it with what was written.
+ */
+static void verify(SimFS *fs, SimFile *files, int n) {
+    char buf[1024];
+    int i;
+    for (i = 0; i < n; i++) {
+        int length = simfs_read(fs, files[i].name, buf, sizeof(buf));
+        check("simfs_read", length);
+        if (length != files[i].size ||
+                memcmp(buf, files[i].data, length) != 0) {
+            fprintf(stderr, "%s reads back wrong\n", files[i].name);
+            exit(1);
+        }
+    }
+}
+
+/* Run rounds of creating, checking and deleting the n files, one call per
+ * file or one per batch, and return the files created per second.
+ */
+static double run(SimFS *fs, SimFile *files, const char **names, int n,
+                  int rounds, int batch) {
+    double start = get_time();
+    int r, i;
+    for (r = 0; r < rounds; r++) {
+        if (batch) {
+            int errors[MAXBATCH];
+            check("simfs_create_many", simfs_create_many(fs, files, n, errors));
+            for (i = 0; i < n; i++) {
+                check(files[i].name, errors[i]);
+            }
+        } else {
+            for (i = 0; i < n; i++) {
+                check("simfs_create", simfs_create(fs, files[i].name,
+                      files[i].size, files[i].data));
+            }
+        }
+
+        verify(fs, files, n);
+
+        if (batch) {
+            int errors[MAXBATCH];
+            check("simfs_delete_many", simfs_delete_many(fs, names, n, errors));
+            for (i = 0; i < n; i++) {
+                check(names[i], errors[i]);
+            }
+        } else {
+            for (i = 0; i < n; i++) {
+                check("simfs_delete", simfs_delete(fs, names[i]));
+            }
+        }
+    }
+    return (double) rounds * n / (get_time() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? strtol(argv[1], NULL, 10) : 10000;
+    int n = argc > 2 ? strtol(argv[2], NULL, 10) : 8;
+    int size = argc > 3 ? strtol(argv[3], NULL, 10) : 48;
+
+    if (rounds <= 0 || n <= 0 || n > MAXBATCH || size <= 0 ||
+            n * size > 1024) {
+        fprintf(stderr, "Usage: %s [rounds [files [size]]]\n", argv[0]);
+        fprintf(stderr, "At most %d files of 1024 bytes in all\n", MAXBATCH);
+        exit(1);
+    }
+
+    char image[] = "/tmp/simfs_loadXXXXXX";
+    int fd = mkstemp(image);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    SimFile files[MAXBATCH];
+    const char *names[MAXBATCH];
+    char name_buf[MAXBATCH][16];
+    char *data = malloc(n * size);
+    if (data == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        snprintf(name_buf[i], sizeof(name_buf[i]), "load%d", i);
+        for (int j = 0; j < size; j++) {
+            data[i * size + j] = 'a' + (i + j / 4) % 26;
+        }
+        files[i].name = names[i] = name_buf[i];
+        files[i].size = size;
+        files[i].data = data + i * size;
+    }
+
+    SimFS *fs;
+    check("simfs_init", simfs_init(image, &fs));
+    double single = run(fs, files, names, n, rounds, 0);
+    double batched = run(fs, files, names, n, rounds, 1);
+    check("simfs_close", simfs_close(fs));
+
+    printf("%d rounds of %d files of %d bytes\n", rounds, n, size);
+    printf("one call per file:  %10.0f files/s\n", single);
+    printf("one call per batch: %10.0f files/s\n", batched);
+
+    free(data);
+    unlink(image);
+    return 0;
+}
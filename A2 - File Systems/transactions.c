@@ -3,6 +3,7 @@
 #include "transactions.h"
 #include "file_ops.h"
 #include "free_list.h"
+#include "dedup.h"
 
 /* Each line of a transaction file represents a single operation on the
  * simulated file system.  A line is divided into several fields and the fields
@@ -11,6 +12,11 @@
  * The first field of a transaction is a single character.
  * c = create_file, d = delete_file, 
  * s = print_freelist, p = print_fs
+ * t = take_snapshot, r = restore_snapshot, u = drop_snapshot
+ * z = turn compression of new files on or off
+ * h = turn deduplication of new files on or off
+ * a = write file data asynchronously (on, or threads to skip io_uring)
+ *     or not (off); each run of creates then forms one batch
  * The remaining fields (if any) are the arguments of the operation in order
  */
 
@@ -33,7 +39,48 @@ static void split(char **args, int num_args, char *line) {
     }
 }
 
+/* Report an error that the transactions cannot go on after, and exit.
+ */
+static void fail(char *operation, int error) {
+    if (error == SIMFS_EIO) {
+        perror(operation);
+    } else {
+        fprintf(stderr, "%s: %s\n", operation, simfs_strerror(error));
+    }
+    exit(1);
+}
+
+/* Report why a file could not be created.
+ */
+static void create_error(char *filename, int error) {
+    if (error == SIMFS_ETOOMANY) {
+        fprintf(stderr, "Error: too many files.  Could not create %s\n",
+                filename);
+    } else if (error == SIMFS_EEXIST) {
+        fprintf(stderr, "Error: file %s already exists\n", filename);
+    } else if (error == SIMFS_ENOSPC) {
+        fprintf(stderr, "Error: no space. Could not create %s\n", filename);
+    } else {
+        fail("create_file", error);
+    }
+}
+
+/* Report why an operation on the snapshot name failed.
+ */
+static void snapshot_error(char *operation, char *name, int error) {
+    if (error == SIMFS_EEXIST) {
+        fprintf(stderr, "Error: snapshot %s already exists\n", name);
+    } else if (error == SIMFS_ETOOMANY) {
+        fprintf(stderr, "Error: too many snapshots. Could not take %s\n", name);
+    } else if (error == SIMFS_ENOENT) {
+        fprintf(stderr, "Error: snapshot %s does not exist\n", name);
+    } else {
+        fail(operation, error);
+    }
+}
+
 void process_transactions(char *transfile) {
+    int error;
     char line[MAXLINE];
     FS *fs = NULL;
 
@@ -64,35 +111,121 @@ void process_transactions(char *transfile) {
         }
 
         if(line[0] == 'i') {
-            fs = init_fs(args[1]);
+            if((error = init_fs(args[1], &fs)) != SIMFS_OK) {
+                fail("init_fs", error);
+            }
         } else if(line[0] == 'o') {
-            fs = open_fs(args[1]);
+            if((error = open_fs(args[1], &fs)) != SIMFS_OK) {
+                fail("open_fs", error);
+            }
         } else {
             fprintf(stderr, "First transaction must be init_fs or open_fs\n");
             exit(1);
         }
     }
 
+    int batching = 0;
     while((fgets(line, MAXLINE, tf)) != NULL) {
         char *args[MAXARGS];
 
         line[strlen(line) - 1] = '\0';
         split(args, MAXARGS, line);
 
+        // a batch of creates ends at the first other transaction
+        if(batching && line[0] != 'c') {
+            if((error = end_batch(fs)) != SIMFS_OK) {
+                fail("end_batch", error);
+            }
+            batching = 0;
+        }
+
         switch(line[0]) {
         case 'd':
             if(args[1] == NULL) {
                 fprintf(stderr, "delete_file must have a file name\n");
                 exit(1);
             }
-            delete_file(fs, args[1]);
+            error = delete_file(fs, args[1]);
+            if(error == SIMFS_ENOENT) {
+                fprintf(stderr, "Error: file %s does not exist\n", args[1]);
+            } else if(error != SIMFS_OK) {
+                fail("delete_file", error);
+            }
             break;
         case 'c':
             if(args[1] == NULL || args[2] == NULL || args[3] == NULL) {
                 fprintf(stderr, "create_file must have a file name, size, and data\n");
                 exit(1);
             }
-            create_file(fs, args[1], atoi(args[2]), args[3]);
+            if(fs->aio != NULL && !batching) {
+                begin_batch(fs);
+                batching = 1;
+            }
+            error = create_file(fs, args[1], atoi(args[2]), args[3]);
+            if(error != SIMFS_OK) {
+                create_error(args[1], error);
+            }
+            break;
+        case 't': // take a snapshot
+            if(args[1] == NULL) {
+                fprintf(stderr, "take_snapshot must have a snapshot name\n");
+                exit(1);
+            }
+            if((error = take_snapshot(fs, args[1])) != SIMFS_OK) {
+                snapshot_error("take_snapshot", args[1], error);
+            }
+            break;
+        case 'r': // roll back to a snapshot
+            if(args[1] == NULL) {
+                fprintf(stderr, "restore_snapshot must have a snapshot name\n");
+                exit(1);
+            }
+            if((error = restore_snapshot(fs, args[1])) != SIMFS_OK) {
+                snapshot_error("restore_snapshot", args[1], error);
+            }
+            break;
+        case 'u': // drop a snapshot
+            if(args[1] == NULL) {
+                fprintf(stderr, "drop_snapshot must have a snapshot name\n");
+                exit(1);
+            }
+            if((error = drop_snapshot(fs, args[1])) != SIMFS_OK) {
+                snapshot_error("drop_snapshot", args[1], error);
+            }
+            break;
+        case 'z': // store new files compressed or not
+            if(args[1] == NULL || (strcmp(args[1], "on") != 0 &&
+                    strcmp(args[1], "off") != 0)) {
+                fprintf(stderr, "compression must be turned on or off\n");
+                exit(1);
+            }
+            fs->compress = strcmp(args[1], "on") == 0;
+            break;
+        case 'h': // share the data of identical files or not
+            if(args[1] == NULL || (strcmp(args[1], "on") != 0 &&
+                    strcmp(args[1], "off") != 0)) {
+                fprintf(stderr, "deduplication must be turned on or off\n");
+                exit(1);
+            }
+            error = set_dedup(fs, strcmp(args[1], "on") == 0);
+            if(error != SIMFS_OK) {
+                fail("set_dedup", error);
+            }
+            break;
+        case 'a': // write file data asynchronously or not
+            if(args[1] == NULL || strcmp(args[1], "on") == 0) {
+                error = simfs_set_async(fs, SIMFS_ASYNC);
+            } else if(strcmp(args[1], "threads") == 0) {
+                error = simfs_set_async(fs, SIMFS_ASYNC_THREADS);
+            } else if(strcmp(args[1], "off") == 0) {
+                error = simfs_set_async(fs, SIMFS_SYNC);
+            } else {
+                fprintf(stderr, "asynchronous writes must be on, threads or off\n");
+                exit(1);
+            }
+            if(error != SIMFS_OK) {
+                fail("set_async", error);
+            }
             break;
         case 's': // show free list
             print_freelist(fs);
@@ -101,7 +234,9 @@ void process_transactions(char *transfile) {
             print_fs(fs);
             break;
         case 'x':  // close the file system file and free the metadata
-            close_fs(fs);
+            if((error = close_fs(fs)) != SIMFS_OK) {
+                fail("close_fs", error);
+            }
             break;
         case '#':  // just do nothing on comment line
             break;
@@ -110,5 +245,8 @@ void process_transactions(char *transfile) {
             exit(1);
         }
     }
+    if(batching && (error = end_batch(fs)) != SIMFS_OK) {
+        fail("end_batch", error);
+    }
     fclose(tf);
 }
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+
+/* Benchmark driver for the closest pair engines. For every input size and
+ * distribution it builds a point file with generate_points, runs closest
+ * with each engine (the fork-based engines once per process tree depth),
+ * checks that every run finds exactly the distance the serial engine found
+ * and prints one CSV row per run to stdout. It expects closest and
+ * generate_points in the current directory.
+ */
+
+#define MAXOUTPUT 4096
+#define MAXSIZES 32
+#define MAXDISTS 8
+
+void print_usage() {
+    fprintf(stderr, "Usage: bench_closest [-n sizes] [-D distributions] [-d maxdepth] [-o dir] [-k]\n\n");
+    fprintf(stderr, "    -n Comma-separated numbers of points (default 1e3 to 1e8)\n");
+    fprintf(stderr, "    -D Comma-separated generate_points distributions (default all)\n");
+    fprintf(stderr, "    -d Deepest process tree to try (default 8)\n");
+    fprintf(stderr, "    -o Directory for the generated inputs (default .)\n");
+    fprintf(stderr, "    -k Keep the generated inputs\n");
+
+    exit(1);
+}
+
+/* Run the program in args[0] and wait for it. Its stdout and stderr are
+ * collected in out, its resource usage in *ru and its wall time in *wall.
+ * Exit if it cannot be run or does not exit successfully.
+ */
+static void run_command(char **args, char *out, struct rusage *ru,
+                        double *wall) {
+    int fd[2];
+    if (pipe(fd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+
+    double start = get_time();
+    int pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        if (close(fd[0]) == -1) {
+            perror("close reading end in child");
+            exit(1);
+        }
+        if (dup2(fd[1], STDOUT_FILENO) == -1 ||
+            dup2(fd[1], STDERR_FILENO) == -1) {
+            perror("dup2");
+            exit(1);
+        }
+        execv(args[0], args);
+        perror(args[0]);
+        exit(1);
+    }
+
+    if (close(fd[1]) == -1) {
+        perror("close writing end in parent");
+        exit(1);
+    }
+
+    // Drain the output before waiting so the child never blocks on the pipe.
+    int total = 0, num_read;
+    while ((num_read = read(fd[0], out + total, MAXOUTPUT - 1 - total)) > 0) {
+        total += num_read;
+    }
+    if (num_read == -1) {
+        perror("read");
+        exit(1);
+    }
+    out[total] = '\0';
+    if (close(fd[0]) == -1) {
+        perror("close reading end in parent");
+        exit(1);
+    }
+
+    int status;
+    if (wait4(pid, &status, 0, ru) == -1) {
+        perror("wait4");
+        exit(1);
+    }
+    *wall = get_time() - start;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed:\n%s", args[0], out);
+        exit(1);
+    }
+}
+
+/* Run closest on filename with the given engine and depth and print its CSV
+ * row. Return the distance it reported.
+ */
+static double bench_run(char *filename, int n, char *dist, char *engine,
+                        int depth, double expected) {
+    char depth_str[16], out[MAXOUTPUT];
+    struct rusage ru;
+    double wall, distance;
+    int processes = 0, threads = 0;
+
+    snprintf(depth_str, sizeof(depth_str), "%d", depth);
+    char *args[] = {"./closest", "-f", filename, "-d", depth_str,
+                    "-e", engine, "-t", NULL};
+    run_command(args, out, &ru, &wall);
+
+    // The first line rounds the distance, so it is compared as printed
+    // at full precision by -t.
+    char *line = strstr(out, "The smallest distance: is ");
+    char *exact = strstr(out, "distance: ");
+    while (exact != NULL && exact > out && exact[-1] != '\n') {
+        exact = strstr(exact + 1, "distance: ");
+    }
+    if (line == NULL || sscanf(line, "The smallest distance: is %*f "
+                               "(total worker processes: %d)",
+                               &processes) != 1 ||
+        exact == NULL || sscanf(exact, "distance: %lf", &distance) != 1) {
+        fprintf(stderr, "Unexpected output from closest:\n%s", out);
+        exit(1);
+    }
+    if ((line = strstr(out, "sort threads: ")) != NULL) {
+        sscanf(line, "sort threads: %d", &threads);
+    }
+
+    // A negative expected distance means this run is the reference.
+    int agrees = expected < 0 || distance == expected;
+    double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+                 ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+    printf("%d,%s,%s,%d,%.17g,%s,%.6f,%.6f,%ld,%d,%d\n", n, dist, engine,
+           depth, distance, agrees ? "yes" : "no", wall, cpu, ru.ru_maxrss,
+           processes, threads);
+    fflush(stdout);
+
+    if (!agrees) {
+        fprintf(stderr, "%s at depth %d disagrees with the serial engine "
+                "on %d %s points\n", engine, depth, n, dist);
+    }
+    return agrees ? distance : -1;
+}
+
+int main(int argc, char **argv) {
+    int sizes[MAXSIZES] = {1000, 10000, 100000, 1000000, 10000000, 100000000};
+    int num_sizes = 6;
+    char *dists[MAXDISTS] = {"uniform", "cluster", "gaussian", "grid", "dup"};
+    int num_dists = 5;
+    int max_depth = 8;
+    char *dir = ".";
+    int keep = 0;
+    int failed = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:D:d:o:k")) != -1) {
+        switch (opt) {
+            case 'n': {
+                char *tok;
+                num_sizes = 0;
+                for (tok = strtok(optarg, ","); tok != NULL && num_sizes < MAXSIZES;
+                     tok = strtok(NULL, ",")) {
+                    sizes[num_sizes++] = (int) strtod(tok, NULL);
+                }
+                break;
+            }
+            case 'D': {
+                char *tok;
+                num_dists = 0;
+                for (tok = strtok(optarg, ","); tok != NULL && num_dists < MAXDISTS;
+                     tok = strtok(NULL, ",")) {
+                    dists[num_dists++] = tok;
+                }
+                break;
+            }
+            case 'd':
+                max_depth = strtol(optarg, NULL, 10);
+                break;
+            case 'o':
+                dir = optarg;
+                break;
+            case 'k':
+                keep = 1;
+                break;
+            case '?':
+            default:
+                print_usage();
+        }
+    }
+
+    printf("size,distribution,engine,depth,distance,agrees,wall_s,cpu_s,"
+           "max_rss_kb,processes,threads\n");
+
+    for (int i = 0; i < num_sizes; i++) {
+        for (int j = 0; j < num_dists; j++) {
+            char filename[1024], n_str[16], out[MAXOUTPUT];
+            struct rusage ru;
+            double wall;
+            int n = sizes[i];
+
+            snprintf(filename, sizeof(filename), "%s/bench_%s_%d.b", dir,
+                     dists[j], n);
+            snprintf(n_str, sizeof(n_str), "%d", n);
+            char *gen_args[] = {"./generate_points", "-D", dists[j], filename,
+                                n_str, NULL};
+            run_command(gen_args, out, &ru, &wall);
+
+            double expected = bench_run(filename, n, dists[j], "serial", 0, -1);
+            if (bench_run(filename, n, dists[j], "grid", 0, expected) < 0) {
+                failed = 1;
+            }
+            if (bench_run(filename, n, dists[j], "soa", 0, expected) < 0) {
+                failed = 1;
+            }
+            for (int depth = 0; depth <= max_depth; depth++) {
+                if (bench_run(filename, n, dists[j], "parallel", depth,
+                              expected) < 0) {
+                    failed = 1;
+                }
+                if (bench_run(filename, n, dists[j], "shm", depth,
+                              expected) < 0) {
+                    failed = 1;
+                }
+            }
+
+            if (!keep && unlink(filename) == -1) {
+                perror(filename);
+                exit(1);
+            }
+        }
+    }
+
+    return failed;
+}
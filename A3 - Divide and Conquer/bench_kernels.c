@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "dynamic_closest.h"
+#include "soa_closest.h"
+
+/* Micro-benchmarks for the kernels used by the closest pair engines.
+ * Each benchmark prints one line per input size.
+ */
+
+
+void print_usage() {
+    fprintf(stderr, "Usage: bench_kernels sort|dynamic|layout|strip|flat [n ...]\n\n");
+    fprintf(stderr, "    sort    Compare qsort() with the radix sort by x and y\n");
+    fprintf(stderr, "    dynamic Compare incremental updates with recomputing\n");
+    fprintf(stderr, "    layout  Compare the cache misses of the serial and soa engines\n");
+    fprintf(stderr, "    strip   Compare the bytes read building strips by scanning and by\n");
+    fprintf(stderr, "            binary search, per level of the recursion\n");
+    fprintf(stderr, "    flat    Compare the engines on points close in x and y with\n");
+    fprintf(stderr, "            uniform points, and fail if they are much slower\n");
+
+    exit(1);
+}
+
+// Return n uniformly random points generated the same way as generate_points.
+static struct Point *random_points(int n) {
+    struct Point *p = malloc(sizeof(struct Point) * n);
+    if (p == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < DIM; k++) {
+            COORD(p[i], k) = rand();
+        }
+    }
+    return p;
+}
+
+/*
+ * Time qsort() against sort_x() and sort_y() on the same random input and
+ * check that both orders agree on the keys.
+ */
+static void bench_sort(int n) {
+    struct Point *orig = random_points(n);
+    struct Point *a = malloc(sizeof(struct Point) * n);
+    struct Point *b = malloc(sizeof(struct Point) * n);
+    if (a == NULL || b == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int by_y = 0; by_y < 2; by_y++) {
+        memcpy(a, orig, sizeof(struct Point) * n);
+        memcpy(b, orig, sizeof(struct Point) * n);
+
+        double start = get_time();
+        qsort(a, n, sizeof(struct Point), by_y ? compare_y : compare_x);
+        double mid = get_time();
+        if (by_y) {
+            sort_y(b, n);
+        } else {
+            sort_x(b, n);
+        }
+        double end = get_time();
+
+        for (int i = 0; i < n; i++) {
+            if ((by_y ? a[i].y != b[i].y : a[i].x != b[i].x)) {
+                fprintf(stderr, "Radix sort disagrees with qsort at %d\n", i);
+                exit(1);
+            }
+        }
+
+        printf("sort_%c n=%d qsort=%.6f s radix=%.6f s speedup=%.2fx\n",
+               by_y ? 'y' : 'x', n, mid - start, end - mid,
+               (mid - start) / (end - mid));
+    }
+
+    free(orig);
+    free(a);
+    free(b);
+}
+
+#define UPDATE_BATCHES 20
+#define BATCH_UPDATES 100
+
+/*
+ * Apply UPDATE_BATCHES batches of BATCH_UPDATES random insertions and
+ * deletions to n random points, once through a DynamicSet and once by
+ * sorting and running closest_serial() on the whole set after every batch,
+ * and check that both give the same distance.
+ */
+static void bench_dynamic(int n) {
+    int capacity = n + UPDATE_BATCHES * BATCH_UPDATES;
+    struct Point *live = random_points(n);
+    struct Point *copy = malloc(sizeof(struct Point) * capacity);
+    live = realloc(live, sizeof(struct Point) * capacity);
+    if (live == NULL || copy == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    int count = n;
+    double incremental = 0, full = 0;
+
+    struct DynamicSet set;
+    dynamic_init(&set, live, count);
+
+    for (int batch = 0; batch < UPDATE_BATCHES; batch++) {
+        double start = get_time();
+        for (int u = 0; u < BATCH_UPDATES; u++) {
+            if (count < 2 || rand() % 2 == 0) {
+                struct Point q;
+                for (int k = 0; k < DIM; k++) {
+                    COORD(q, k) = rand();
+                }
+                live[count++] = q;
+                dynamic_insert(&set, q);
+            } else {
+                int victim = rand() % count;
+                if (dynamic_delete(&set, live[victim]) == -1) {
+                    fprintf(stderr, "Point %d went missing\n", victim);
+                    exit(1);
+                }
+                live[victim] = live[--count];
+            }
+        }
+        double d_incremental = dynamic_closest(&set).d;
+        double mid = get_time();
+
+        memcpy(copy, live, sizeof(struct Point) * count);
+        sort_x(copy, count);
+        double d_full = closest_serial(copy, count).d;
+        double end = get_time();
+
+        if (d_incremental != d_full) {
+            fprintf(stderr, "Batch %d: incremental %f, recomputed %f\n",
+                    batch, d_incremental, d_full);
+            exit(1);
+        }
+        incremental += mid - start;
+        full += end - mid;
+    }
+
+    printf("dynamic n=%d batches=%d updates=%d incremental=%.6f s full=%.6f s "
+           "speedup=%.2fx recomputes=%d\n", n, UPDATE_BATCHES, BATCH_UPDATES,
+           incremental, full, full / incremental, set.recomputes);
+
+    dynamic_free(&set);
+    free(live);
+    free(copy);
+}
+
+/*
+ * Open a counter of the cache misses of this process in user space, or
+ * return -1 if the kernel or the machine does not provide one.
+ */
+static int open_cache_counter() {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Reset and start the counter fd, if there is one.
+static void start_counter(int fd) {
+    if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Stop the counter fd and return its value, or -1 if there is none.
+static long long stop_counter(int fd) {
+    long long value;
+
+    if (fd == -1) {
+        return -1;
+    }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+        perror("read");
+        exit(1);
+    }
+    return value;
+}
+
+// Print the misses counted for one engine, or why there are none.
+static void print_misses(char *engine, long long misses, double time) {
+    if (misses == -1) {
+        printf(" %s=%.6f s (misses unavailable)", engine, time);
+    } else {
+        printf(" %s=%.6f s %lld misses", engine, time, misses);
+    }
+}
+
+/*
+ * Sort the same n random points and find their closest pair once with
+ * sort_x() and closest_serial() on struct Point, and once with the
+ * separate coordinate arrays of the soa engine, counting the cache misses
+ * of each. Both have to find the same distance.
+ */
+static void bench_layout(int n) {
+    struct Point *p = random_points(n);
+    struct PointsSoA soa;
+    int fd = open_cache_counter();
+
+    soa_init(&soa, p, n);
+
+    double start = get_time();
+    start_counter(fd);
+    sort_x(p, n);
+    double d_aos = closest_serial(p, n).d;
+    long long aos_misses = stop_counter(fd);
+    double mid = get_time();
+
+    start_counter(fd);
+    soa_sort_x(&soa);
+    double d_soa = closest_soa(&soa).d;
+    long long soa_misses = stop_counter(fd);
+    double end = get_time();
+
+    if (d_aos != d_soa) {
+        fprintf(stderr, "serial found %f, soa found %f\n", d_aos, d_soa);
+        exit(1);
+    }
+
+    printf("layout n=%d", n);
+    print_misses("serial", aos_misses, mid - start);
+    print_misses("soa", soa_misses, end - mid);
+    if (aos_misses > 0 && soa_misses > 0) {
+        printf(" reduction=%.2fx", (double) aos_misses / soa_misses);
+    }
+    printf(" speedup=%.2fx\n", (mid - start) / (end - mid));
+
+    if (fd != -1) {
+        close(fd);
+    }
+    soa_free(&soa);
+    free(p);
+}
+
+// Deepest recursion level that bench_strip() keeps totals for
+#define STRIP_LEVELS 64
+
+// What the strips of one level of the recursion cost for bench_strip().
+struct strip_level {
+    long nodes;
+    long points;        // Points of the nodes, all of which a scan reads
+    long probes;        // Points read by the binary searches
+    long strip;         // Points copied into strips
+    double scan_time, search_time;
+};
+
+/*
+ * Find the closest pair of p[] like closest_serial(), building every strip
+ * both by scanning all the points of the node and with build_strip(), and
+ * check that the two strips are the same. Like build_strip(), the scan
+ * allocates its strip for each node, as closest_serial() did before it, so
+ * that both times include one malloc().
+ */
+static struct Pair strip_node(struct Point *p, int n, int level,
+                              struct strip_level *levels) {
+    if (n <= get_serial_cutoff()) {
+        return brute_force(p, n);
+    }
+
+    int mid = n / 2;
+    struct Pair best = min_pair(
+        strip_node(p, mid, level + 1, levels),
+        strip_node(p + mid, n - mid, level + 1, levels));
+    double d = best.d;
+
+    double start = get_time();
+    struct Point *scratch = malloc(sizeof(struct Point) * n);
+    if (scratch == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (COORD_GAP(p[i].x, p[mid].x) < d) {
+            scratch[count++] = p[i];
+        }
+    }
+    double scanned = get_time();
+    int size, left;
+    struct Point *strip = build_strip(p, n, mid, d, &size, &left, NULL);
+    double searched = get_time();
+
+    if (size != count ||
+        memcmp(strip, scratch, sizeof(struct Point) * size) != 0) {
+        fprintf(stderr, "build_strip disagrees with a scan at level %d\n",
+                level);
+        exit(1);
+    }
+    free(scratch);
+
+    int lo, hi;
+    struct strip_level *l = &levels[level];
+    l->nodes++;
+    l->points += n;
+    l->probes += strip_bounds(p, n, mid, d, &lo, &hi);
+    l->strip += size;
+    l->scan_time += scanned - start;
+    l->search_time += searched - scanned;
+
+    best = strip_closest(strip, NULL, size, left, best);
+    free(strip);
+    return best;
+}
+
+/*
+ * Compare building the strips of closest_serial() on n random points by
+ * scanning every point of a node with the binary search of build_strip().
+ * For each level, print the bytes of points each one reads and writes and
+ * the time each takes.
+ */
+static void bench_strip(int n) {
+    struct Point *p = random_points(n);
+    struct strip_level levels[STRIP_LEVELS];
+    memset(levels, 0, sizeof(levels));
+
+    sort_x(p, n);
+    double d = strip_node(p, n, 0, levels).d;
+    double serial_d = closest_serial(p, n).d;
+    if (d != serial_d) {
+        fprintf(stderr, "closest_serial found %f, the strip check found %f\n",
+                serial_d, d);
+        exit(1);
+    }
+
+    long scan_total = 0, search_total = 0;
+    for (int level = 0; level < STRIP_LEVELS && levels[level].nodes > 0;
+         level++) {
+        struct strip_level *l = &levels[level];
+        long scan_bytes = (l->points + l->strip) * sizeof(struct Point);
+        long search_bytes = (l->probes + 2 * l->strip) * sizeof(struct Point);
+        scan_total += scan_bytes;
+        search_total += search_bytes;
+        printf("strip n=%d level=%d nodes=%ld strip=%ld scan=%ld bytes "
+               "%.6f s search=%ld bytes %.6f s\n", n, level, l->nodes,
+               l->strip, scan_bytes, l->scan_time, search_bytes,
+               l->search_time);
+    }
+    printf("strip n=%d total scan=%ld bytes search=%ld bytes reduction=%.2fx\n",
+           n, scan_total, search_total, (double) scan_total / search_total);
+
+    free(p);
+}
+
+/*
+ * Largest slowdown bench_flat() accepts on flat points against uniform
+ * ones. Their strips cost a few times more to search, but by a factor that
+ * does not grow with n.
+ */
+#define FLAT_SLOWDOWN 20.0
+
+/*
+ * Time one engine on p[], which is left sorted by x, and populate *d with
+ * the distance it finds: closest_serial() unless soa is set, and
+ * closest_soa() otherwise.
+ */
+static double time_engine(struct Point *p, int n, int soa, double *d) {
+    double start = get_time();
+    if (soa) {
+        struct PointsSoA s;
+        soa_init(&s, p, n);
+        soa_sort_x(&s);
+        *d = closest_soa(&s).d;
+        soa_free(&s);
+    } else {
+        sort_x(p, n);
+        *d = closest_serial(p, n).d;
+    }
+    return get_time() - start;
+}
+
+/*
+ * Time the serial and soa engines on n points whose x and y are all within
+ * 1000 of each other but whose other coordinates are uniform, against n
+ * uniform points. Past 2D every point of such an input is close to the
+ * dividing line in x and y, so a strip searched on y alone compares nearly
+ * all pairs of it. Exit with status 1 if either engine is more than
+ * FLAT_SLOWDOWN times slower on it, or if the engines disagree.
+ */
+static void bench_flat(int n) {
+    struct Point *flat = random_points(n);
+    struct Point *uniform = random_points(n);
+    for (int i = 0; i < n; i++) {
+        flat[i].x = rand() % 1000;
+        flat[i].y = rand() % 1000;
+    }
+
+    char *names[] = {"serial", "soa"};
+    double d[2], ratio[2];
+    int slow = 0;
+    printf("flat n=%d", n);
+    for (int soa = 0; soa < 2; soa++) {
+        double d_uniform;
+        double flat_time = time_engine(flat, n, soa, &d[soa]);
+        double uniform_time = time_engine(uniform, n, soa, &d_uniform);
+        ratio[soa] = flat_time / uniform_time;
+        slow = slow || ratio[soa] > FLAT_SLOWDOWN;
+        printf(" %s flat=%.6f s uniform=%.6f s slowdown=%.2fx", names[soa],
+               flat_time, uniform_time, ratio[soa]);
+    }
+    printf("\n");
+
+    if (d[0] != d[1]) {
+        fprintf(stderr, "serial found %f, soa found %f\n", d[0], d[1]);
+        exit(1);
+    }
+    if (slow) {
+        fprintf(stderr, "Flat points are more than %.0fx slower than uniform "
+                "ones\n", FLAT_SLOWDOWN);
+        exit(1);
+    }
+
+    free(flat);
+    free(uniform);
+}
+
+int main(int argc, char **argv) {
+    int default_sizes[] = {100000, 1000000, 10000000, 100000000};
+    int num_defaults = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    void (*bench)(int);
+
+    if (argc < 2) {
+        print_usage();
+    } else if (strcmp(argv[1], "sort") == 0) {
+        bench = bench_sort;
+    } else if (strcmp(argv[1], "dynamic") == 0) {
+        bench = bench_dynamic;
+    } else if (strcmp(argv[1], "layout") == 0) {
+        bench = bench_layout;
+    } else if (strcmp(argv[1], "strip") == 0) {
+        bench = bench_strip;
+    } else if (strcmp(argv[1], "flat") == 0) {
+        bench = bench_flat;
+    } else {
+        print_usage();
+    }
+
+    if (argc == 2) {
+        for (int i = 0; i < num_defaults; i++) {
+            bench(default_sizes[i]);
+        }
+    } else {
+        for (int i = 2; i < argc; i++) {
+            bench(strtol(argv[i], NULL, 10));
+        }
+    }
+
+    return 0;
+}
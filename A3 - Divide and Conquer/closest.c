@@ -1,30 +1,509 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <float.h>
 #include <assert.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "point.h"
 #include "utilities_closest.h"
 #include "serial_closest.h"
 #include "parallel_closest.h"
+#include "parallel_sort.h"
+#include "grid_closest.h"
+#include "topk_closest.h"
+#include "dynamic_closest.h"
+#include "soa_closest.h"
+#include "neighbours_closest.h"
+#include "external_closest.h"
+#include "tuning.h"
+#include "trace_closest.h"
+
+/* Maximum length of a line in an update file */
+#define MAXLINE 256
+
+/* Subsets of the input that verify mode also solves by brute force, and
+ * their size
+ */
+#define VERIFY_SAMPLES 8
+#define VERIFY_SAMPLE_POINTS 2000
 
 
 void print_usage() {
-    fprintf(stderr, "Usage: closest -f filename -d pdepth\n\n");
-    fprintf(stderr, "    -d Maximum process tree depth\n");
+    fprintf(stderr, "Usage: closest -f filename [-d pdepth] [-e engine] [-k count] [-p] [-t] [-T trace]\n");
+    fprintf(stderr, "       closest -f filename -u updates [-t]\n");
+    fprintf(stderr, "       closest -f filename -a [-d pdepth] [-t]\n");
+    fprintf(stderr, "       closest -f filename -m memory [-t]\n");
+    fprintf(stderr, "       closest -f filename --verify [-d pdepth] [-e engine]\n");
+    fprintf(stderr, "       closest -c [-f filename]\n\n");
+    fprintf(stderr, "    -a Find the nearest neighbour of every point and write their\n");
+    fprintf(stderr, "       positions to filename.nn\n");
+    fprintf(stderr, "    -c Calibrate the thresholds for this host and save them\n");
+    fprintf(stderr, "    -d Maximum process tree depth, or auto (the default)\n");
+    fprintf(stderr, "    -e Algorithm to run: parallel (default), shm, serial, grid or soa\n");
     fprintf(stderr, "    -f File that contains the input points\n");
+    fprintf(stderr, "    -k Report the count closest pairs (serial and parallel only)\n");
+    fprintf(stderr, "    -m Sort and solve the file in slabs using about this much memory,\n");
+    fprintf(stderr, "       in bytes or with a K, M or G suffix (at least 1M)\n");
+    fprintf(stderr, "    -p Report which points form the closest pair\n");
+    fprintf(stderr, "    -t Report the time spent in each phase on stderr\n");
+    fprintf(stderr, "    -T Profile each level of the recursion, write a Chrome trace to\n");
+    fprintf(stderr, "       this file and print the totals per level (serial and parallel only)\n");
+    fprintf(stderr, "    -u Apply batches of insertions and deletions from this file\n");
+    fprintf(stderr, "    -v, --verify\n");
+    fprintf(stderr, "       Run the engine, the serial engine and brute force on sampled\n");
+    fprintf(stderr, "       subsets at the same time, check that they agree exactly and\n");
+    fprintf(stderr, "       report the speedup; exit with status 1 if they do not agree\n");
 
     exit(1);
 }
 
+/*
+ * Apply the updates in update_file to the n points of p[] and report the
+ * closest distance after each batch. Each line of the file is one of
+ *   i x y   insert the point (x, y)
+ *   d x y   delete a point at (x, y)
+ *   b       end the current batch
+ * and lines starting with # are ignored. The end of the file ends the last
+ * batch. In builds for more dimensions, points have DIM coordinates. With
+ * timing set, the time spent on each batch goes to stderr.
+ */
+static void run_updates(struct Point *p, int n, char *update_file, int timing) {
+    char line[MAXLINE];
+    struct DynamicSet set;
+    int batch = 0, pending = 0;
+
+    FILE *uf = fopen(update_file, "r");
+    if (uf == NULL) {
+        perror(update_file);
+        exit(1);
+    }
+
+    double start = get_time();
+    dynamic_init(&set, p, n);
+    if (timing) {
+        fprintf(stderr, "build: %.6f s\n", get_time() - start);
+    }
+
+    start = get_time();
+    for (;;) {
+        char *result = fgets(line, MAXLINE, uf);
+        struct Point q;
+
+        if (result == NULL || line[0] == 'b') {
+            if (result != NULL || pending) {
+                struct Pair best = dynamic_closest(&set);
+                double end = get_time();
+                printf("After batch %d (%d points): the smallest distance: is %.2f\n",
+                       batch, set.count, best.d);
+                if (timing) {
+                    fprintf(stderr, "batch %d: %.6f s\n", batch, end - start);
+                }
+                batch++;
+                pending = 0;
+                start = get_time();
+            }
+            if (result == NULL) {
+                break;
+            }
+        } else if (line[0] == 'i' || line[0] == 'd') {
+            if (!parse_point(line + 1, &q)) {
+                fprintf(stderr, "Error: bad update, %s", line);
+                exit(1);
+            }
+            if (line[0] == 'i') {
+                dynamic_insert(&set, q);
+            } else if (dynamic_delete(&set, q) == -1) {
+                fprintf(stderr, "Error: point ");
+                print_point(stderr, q);
+                fprintf(stderr, " does not exist\n");
+            }
+            pending = 1;
+        } else if (line[0] != '#' && line[0] != '\n') {
+            fprintf(stderr, "Error: bad update, %s", line);
+            exit(1);
+        }
+    }
+
+    if (timing) {
+        fprintf(stderr, "full recomputations: %d\n", set.recomputes);
+    }
+    dynamic_free(&set);
+    fclose(uf);
+}
+
+/*
+ * Return the number of bytes in s, a number with an optional K, M or G
+ * suffix, or 0 if it is not one.
+ */
+static size_t parse_size(char *s) {
+    char *endptr;
+    unsigned long size = strtoul(s, &endptr, 10);
+    if (endptr == s) {
+        return 0;
+    }
+
+    int shift = 0;
+    if (*endptr == 'K' || *endptr == 'k') {
+        shift = 10;
+    } else if (*endptr == 'M' || *endptr == 'm') {
+        shift = 20;
+    } else if (*endptr == 'G' || *endptr == 'g') {
+        shift = 30;
+    }
+    if (shift > 0) {
+        endptr++;
+    }
+    if (*endptr != '\0' || size > (~0UL >> shift)) {
+        return 0;
+    }
+    return size << shift;
+}
+
+/*
+ * Find the nearest neighbour of each of the n points of p[], which are in
+ * the order of the file filename, write them to filename.nn and report the
+ * smallest of their distances, which is the closest pair's.
+ */
+static void run_neighbours(struct Point *p, int n, char *filename, int pdepth,
+                           int timing) {
+    int pcount = 0;
+    int *nn = malloc(sizeof(int) * n + 1);
+    double *nd = malloc(sizeof(double) * n + 1);
+    if (nn == NULL || nd == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    double start = get_time();
+    all_nearest(p, n, pdepth, &pcount, nn, nd);
+    double computed = get_time();
+    write_neighbours(filename, nn, n);
+    double written = get_time();
+
+    double smallest = DBL_MAX;
+    for (int i = 0; i < n; i++) {
+        smallest = min(smallest, nd[i]);
+    }
+    printf("The smallest distance: is %.2f (total worker processes: %d)\n",
+           smallest, pcount);
+    printf("Nearest neighbours written to %s.nn\n", filename);
+
+    if (timing) {
+        fprintf(stderr, "compute: %.6f s\n", computed - start);
+        fprintf(stderr, "write: %.6f s\n", written - computed);
+        fprintf(stderr, "depth: %d\n", pdepth);
+    }
+    free(nn);
+    free(nd);
+}
+
+/*
+ * Sort the n points of p[] as engine needs them, using as many workers as
+ * the parallel algorithm. The grid engine works on unsorted points, and the
+ * soa engine sorts its own copy of them into *soa. Unless ids is NULL,
+ * ids[] is permuted along with p[], so that the positions in the pairs
+ * found by the engine can be mapped back through it. Return the number of
+ * sort threads.
+ */
+static int sort_for_engine(char *engine, struct Point *p, int *ids, int n,
+                           int pdepth, struct PointsSoA *soa) {
+    if (strcmp(engine, "soa") == 0) {
+        soa_init(soa, p, n);
+        soa_sort_x(soa);
+    } else if (strcmp(engine, "grid") != 0) {
+        return sort_parallel(p, ids, n, pdepth);
+    }
+    return 0;
+}
+
+/*
+ * Find the closest pair of the n points of p[], prepared by
+ * sort_for_engine(), with engine. The number of workers is added to
+ * *pcount.
+ */
+static struct Pair solve_engine(char *engine, struct Point *p, int n,
+                                int pdepth, int *pcount, struct PointsSoA *soa) {
+    struct Pair result_p;
+    if (strcmp(engine, "serial") == 0) {
+        result_p = closest_serial(p, n);
+    } else if (strcmp(engine, "grid") == 0) {
+        result_p = closest_grid(p, n);
+    } else if (strcmp(engine, "soa") == 0) {
+        result_p = closest_soa(soa);
+        soa_free(soa);
+    } else if (strcmp(engine, "shm") == 0) {
+        result_p = closest_parallel_shm(p, n, pdepth, pcount);
+    } else {
+        result_p = closest_parallel(p, n, pdepth, pcount);
+    }
+    return result_p;
+}
+
+// What a verification process sends back through its pipe.
+struct verify_result {
+    struct Pair best;
+    double time;        // Time to sort and solve
+    int workers;        // Worker processes of the engine
+    int mismatches;     // Sampled subsets on which an engine was wrong
+};
+
+// Sort and solve the n points of p[] with engine and time it.
+static struct verify_result time_engine(char *engine, struct Point *p, int n,
+                                        int pdepth) {
+    struct verify_result r;
+    struct PointsSoA soa;
+
+    memset(&r, 0, sizeof(r));
+    double start = get_time();
+    sort_for_engine(engine, p, NULL, n, pdepth, &soa);
+    r.best = solve_engine(engine, p, n, pdepth, &r.workers, &soa);
+    r.time = get_time() - start;
+    return r;
+}
+
+// Return a random number in [0, bound) for bounds beyond RAND_MAX.
+static long random_below(long bound) {
+    return (((long) rand() << 31) | rand()) % bound;
+}
+
+/*
+ * Solve VERIFY_SAMPLES subsets of the n points of p[] with engine, the
+ * serial engine and brute force, and count the subsets on which they do
+ * not all agree. Every other subset is drawn at random, and the others are
+ * runs of consecutive points in x order, where the points are densest.
+ * p[] is sorted in place.
+ */
+static struct verify_result check_samples(char *engine, struct Point *p, int n,
+                                          int pdepth) {
+    struct verify_result r;
+    int m = n < VERIFY_SAMPLE_POINTS ? n : VERIFY_SAMPLE_POINTS;
+    int *idx = malloc(sizeof(int) * n + 1);
+    struct Point *sample = malloc(sizeof(struct Point) * m + 1);
+    struct Point *copy = malloc(sizeof(struct Point) * m + 1);
+    if (idx == NULL || sample == NULL || copy == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    memset(&r, 0, sizeof(r));
+    sort_x(p, n);
+    for (int i = 0; i < n; i++) {
+        idx[i] = i;
+    }
+
+    srand(1);
+    for (int s = 0; s < VERIFY_SAMPLES; s++) {
+        if (s % 2 == 0) {
+            // The first m steps of a Fisher-Yates shuffle pick m points.
+            for (int i = 0; i < m; i++) {
+                int j = i + random_below(n - i);
+                int tmp = idx[i];
+                idx[i] = idx[j];
+                idx[j] = tmp;
+                sample[i] = p[idx[i]];
+            }
+        } else {
+            memcpy(sample, p + random_below(n - m + 1),
+                   sizeof(struct Point) * m);
+        }
+
+        struct Pair expected = brute_force(sample, m);
+        memcpy(copy, sample, sizeof(struct Point) * m);
+        struct Pair fast = time_engine(engine, copy, m, pdepth).best;
+        memcpy(copy, sample, sizeof(struct Point) * m);
+        struct Pair serial = time_engine("serial", copy, m, 0).best;
+
+        if (fast.d != expected.d || serial.d != expected.d) {
+            fprintf(stderr, "Verify: on sample %d brute force found %.17g, "
+                    "%s %.17g and serial %.17g\n", s, expected.d, engine,
+                    fast.d, serial.d);
+            r.mismatches++;
+        }
+    }
+
+    free(idx);
+    free(sample);
+    free(copy);
+    return r;
+}
+
+/*
+ * Fork a process that runs check_samples() if samples is set and
+ * time_engine() otherwise on the n points of p[], and sends the result back
+ * through a pipe. The child sorts its own copy of the points. Return the
+ * reading end of the pipe and store the child's pid in *pid.
+ */
+static int fork_verifier(int samples, char *engine, struct Point *p, int n,
+                         int pdepth, int *pid) {
+    int fd[2];
+    if (pipe(fd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+
+    *pid = fork();
+    if (*pid == -1) {
+        perror("fork");
+        exit(1);
+    } else if (*pid == 0) {
+        if (close(fd[0]) == -1) {
+            perror("close reading end in verifier");
+            exit(1);
+        }
+        struct verify_result r = samples ? check_samples(engine, p, n, pdepth)
+                                         : time_engine(engine, p, n, pdepth);
+        if (write(fd[1], &r, sizeof(r)) != sizeof(r)) {
+            perror("write from verifier to pipe");
+            exit(1);
+        }
+        if (close(fd[1]) == -1) {
+            perror("close writing end in verifier");
+            exit(1);
+        }
+        exit(0);
+    }
+
+    if (close(fd[1]) == -1) {
+        perror("close writing end of verifier's pipe");
+        exit(1);
+    }
+    return fd[0];
+}
+
+// Return whether best.d is the distance between the points of best.
+static int consistent(struct Pair best) {
+    return best.d == DBL_MAX || dist(best.p1, best.p2) == best.d;
+}
+
+/*
+ * Find the closest pair of the n points of p[] with engine, and at the same
+ * time with the serial engine and with brute force on samples, each in its
+ * own process. Report the result, the speedup over the serial engine and
+ * whether everything agreed. Exit with status 1 if it did not.
+ */
+static void run_verify(char *engine, struct Point *p, int n, int pdepth) {
+    struct verify_result results[3];
+    int pids[3], fds[3];
+
+    fds[0] = fork_verifier(0, engine, p, n, pdepth, &pids[0]);
+    fds[1] = fork_verifier(0, "serial", p, n, 0, &pids[1]);
+    fds[2] = fork_verifier(1, engine, p, n, pdepth, &pids[2]);
+
+    for (int i = 0; i < 3; i++) {
+        if (read(fds[i], &results[i], sizeof(results[i])) !=
+            sizeof(results[i])) {
+            fprintf(stderr, "A verification process failed\n");
+            exit(1);
+        }
+        close(fds[i]);
+
+        int status;
+        if (waitpid(pids[i], &status, 0) == -1) {
+            perror("waitpid");
+            exit(1);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "A verification process failed\n");
+            exit(1);
+        }
+    }
+
+    struct verify_result *fast = &results[0], *serial = &results[1];
+    int agree = 1;
+
+    printf("The smallest distance: is %.2f (total worker processes: %d)\n",
+           fast->best.d, fast->workers);
+    printf("Verify: %s took %.6f s and serial %.6f s, a speedup of %.2fx\n",
+           engine, fast->time, serial->time, serial->time / fast->time);
+
+    if (fast->best.d != serial->best.d) {
+        printf("Verify: %s found %.17g but serial found %.17g\n", engine,
+               fast->best.d, serial->best.d);
+        agree = 0;
+    }
+    if (!consistent(fast->best) || !consistent(serial->best)) {
+        printf("Verify: a reported pair is not at the reported distance\n");
+        agree = 0;
+    }
+    if (n >= 2) {
+        printf("Verify: %d of %d sampled subsets of %d points agree with "
+               "brute force\n", VERIFY_SAMPLES - results[2].mismatches,
+               VERIFY_SAMPLES, n < VERIFY_SAMPLE_POINTS ? n : VERIFY_SAMPLE_POINTS);
+        agree = agree && results[2].mismatches == 0;
+    }
+
+    printf("Verify: %s\n", agree ? "all results agree" : "FAILED");
+    if (!agree) {
+        exit(1);
+    }
+}
+
+// Number of random points used to calibrate when no input file is given
+#define CALIBRATION_POINTS 1000000
+
+/*
+ * Calibrate the thresholds on the points in filename, or on random points
+ * if it is NULL, and save them for later runs.
+ */
+static void run_calibration(struct Tuning *tuning, char *filename) {
+    struct Point *p;
+    int n;
+
+    if (filename != NULL) {
+        p = load_points(filename, &n);
+    } else {
+        n = CALIBRATION_POINTS;
+        p = malloc(sizeof(struct Point) * n);
+        if (p == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (int i = 0; i < n; i++) {
+            for (int k = 0; k < DIM; k++) {
+                COORD(p[i], k) = rand();
+            }
+        }
+    }
+
+    sort_x(p, n);
+    calibrate(tuning, p, n);
+    save_tuning(tuning);
+
+    if (filename != NULL) {
+        unload_points(p, n);
+    } else {
+        free(p);
+    }
+}
+
 int main(int argc, char **argv) {
     int n = -1;
     long pdepth = -1;
     char *filename = NULL;
     int pcount = 0;
+    int tcount = 0;
+    int timing = 0;
+    int show_pair = 0;
+    int k = 1;
+    char *engine = "parallel";
+    char *update_file = NULL;
+    int calibrating = 0;
+    int neighbours = 0;
+    char *trace_file = NULL;
+    size_t budget = 0;
+    int verify = 0;
+    struct option long_options[] = {
+        {"verify", no_argument, NULL, 'v'},
+        {NULL, 0, NULL, 0}
+    };
+    struct Tuning tuning;
 
     //Parse the command line arguments
-    if (argc != 5) {
+    if (argc < 2) {
         print_usage();
         //exit(1);
     }
@@ -36,38 +515,232 @@ int main(int argc, char **argv) {
     // You may assume that pdepth will be less than or equal to 8.
 
     int opt;
-    while ((opt = getopt(argc, argv, "f:d:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "acf:d:e:k:m:ptT:u:v", long_options,
+                              NULL)) != -1) {
         switch (opt) {
+            case 'a':
+                neighbours = 1;
+                break;
+            case 'c':
+                calibrating = 1;
+                break;
             case 'f':
                 filename = optarg;  
                 break;
             case 'd': {
                 char *endptr;
                 pdepth = strtol(optarg, &endptr, 10);
+                if (strcmp(optarg, "auto") == 0) {
+                    pdepth = -1;
+                } else if (*endptr != '\0' || pdepth < 0) {
+                    print_usage();
+                }
                 break;
             }
+            case 'e':
+                engine = optarg;
+                break;
+            case 'k':
+                k = strtol(optarg, NULL, 10);
+                break;
+            case 'm':
+                budget = parse_size(optarg);
+                if (budget < EXTERNAL_MIN_BUDGET) {
+                    print_usage();
+                }
+                break;
+            case 'p':
+                show_pair = 1;
+                break;
+            case 't':
+                timing = 1;
+                break;
+            case 'T':
+                trace_file = optarg;
+                break;
+            case 'u':
+                update_file = optarg;
+                break;
+            case 'v':
+                verify = 1;
+                break;
             case '?':
             default:
                 print_usage();
         }
     }
 
-    // Ensure both options -f and -d are provided
-    if (!filename || pdepth == -1) {
+    load_tuning(&tuning);
+    apply_tuning(&tuning);
+
+    if (calibrating) {
+        run_calibration(&tuning, filename);
+        exit(0);
+    }
+
+    // The serial, grid and soa engines and the update mode run in a single
+    // process, so they need no depth.
+    if (strcmp(engine, "serial") == 0 || strcmp(engine, "grid") == 0 ||
+        strcmp(engine, "soa") == 0 || update_file != NULL) {
+        pdepth = 0;
+    } else if (strcmp(engine, "parallel") != 0 && strcmp(engine, "shm") != 0) {
         print_usage();
     }
 
-    // Read the points
-    n = total_points(filename);
-    struct Point points_arr[n];
-    read_points(filename, points_arr);
+    // Ensure option -f is provided
+    if (!filename) {
+        print_usage();
+    }
 
-    // Sort the points
-    qsort(points_arr, n, sizeof(struct Point), compare_x);
+    if (k < 1 || (k > 1 && strcmp(engine, "serial") != 0 &&
+                  strcmp(engine, "parallel") != 0)) {
+        print_usage();
+    }
+
+    // The out-of-core mode never loads the whole file, so it runs before
+    // anything else.
+    if (budget > 0) {
+        if (k > 1 || update_file != NULL || neighbours || trace_file != NULL ||
+            show_pair || verify) {
+            print_usage();
+        }
+        struct Pair best = closest_external(filename, budget, timing);
+        printf("The smallest distance: is %.2f (total worker processes: %d)\n",
+               best.d, 0);
+        exit(0);
+    }
+
+    if (verify && (k > 1 || update_file != NULL || neighbours || show_pair ||
+                   trace_file != NULL)) {
+        print_usage();
+    }
+
+    if (trace_file != NULL && (k > 1 || update_file != NULL || neighbours ||
+                               (strcmp(engine, "serial") != 0 &&
+                                strcmp(engine, "parallel") != 0))) {
+        print_usage();
+    }
+
+    // Map the points instead of copying them onto the stack, so inputs far
+    // larger than the stack can be processed.
+    double start = get_time();
+    struct Point *points_arr = load_points(filename, &n);
+    double loaded = get_time();
+
+    if (update_file != NULL) {
+        if (timing) {
+            fprintf(stderr, "load: %.6f s\n", loaded - start);
+        }
+        run_updates(points_arr, n, update_file, timing);
+        unload_points(points_arr, n);
+        exit(0);
+    }
+
+    // Without a depth, pick one for this input and host, and stop forking
+    // for subarrays below the calibrated cutoff.
+    if (pdepth == -1) {
+        pdepth = auto_depth(&tuning, n);
+        set_fork_cutoff(tuning.fork_cutoff);
+    }
+
+    // The neighbours are found before sorting, while the points are still
+    // in the order of the file.
+    if (neighbours) {
+        if (timing) {
+            fprintf(stderr, "load: %.6f s\n", loaded - start);
+        }
+        run_neighbours(points_arr, n, filename, pdepth, timing);
+        unload_points(points_arr, n);
+        exit(0);
+    }
+
+    // The verification processes sort their own copies of the points.
+    if (verify) {
+        run_verify(engine, points_arr, n, pdepth);
+        unload_points(points_arr, n);
+        exit(0);
+    }
+
+    // Tracing starts before the sort so that the sort threads are traced
+    // too, and before the first fork so that the workers share the buffer.
+    if (trace_file != NULL) {
+        trace_start();
+    }
+
+    // Sort the points, using as many workers as the parallel algorithm.
+    // When pairs are printed, order[] follows each point from its position
+    // in the file.
+    int *order = NULL;
+    if (k > 1 || show_pair) {
+        order = malloc(sizeof(int) * (n > 0 ? n : 1));
+        if (order == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (int i = 0; i < n; i++) {
+            order[i] = i;
+        }
+    }
+    struct PointsSoA soa;
+    tcount = sort_for_engine(engine, points_arr, order, n, pdepth, &soa);
+    double sorted = get_time();
+
+    // Calculate the result using the selected algorithm. The k closest
+    // pairs are kept in a heap, sorted from closest to farthest at the end.
+    struct PairHeap closest_pairs;
+    heap_init(&closest_pairs, k);
+    if (k > 1) {
+        if (strcmp(engine, "serial") == 0) {
+            closest_serial_k(points_arr, n, &closest_pairs);
+        } else {
+            closest_parallel_k(points_arr, n, pdepth, &pcount, &closest_pairs);
+        }
+        heap_sort(&closest_pairs);
+    } else {
+        heap_push(&closest_pairs, solve_engine(engine, points_arr, n, pdepth,
+                                               &pcount, &soa));
+    }
+    double computed = get_time();
+
+    if (k == 1) {
+        printf("The smallest distance: is %.2f (total worker processes: %d)\n",
+               closest_pairs.pairs[0].d, pcount);
+    } else {
+        printf("The %d smallest distances (total worker processes: %d):\n",
+               closest_pairs.size, pcount);
+    }
+
+    if (k > 1 || show_pair) {
+        for (int i = 0; i < closest_pairs.size; i++) {
+            struct Pair *pair = &closest_pairs.pairs[i];
+            printf("%.2f between point %d ", pair->d,
+                   pair->i1 != -1 ? order[pair->i1] : -1);
+            print_point(stdout, pair->p1);
+            printf(" and point %d ",
+                   pair->i2 != -1 ? order[pair->i2] : -1);
+            print_point(stdout, pair->p2);
+            printf("\n");
+        }
+        free(order);
+    }
+
+    if (timing) {
+        fprintf(stderr, "load: %.6f s\n", loaded - start);
+        fprintf(stderr, "sort: %.6f s\n", sorted - loaded);
+        fprintf(stderr, "compute: %.6f s\n", computed - sorted);
+        fprintf(stderr, "sort threads: %d\n", tcount);
+        fprintf(stderr, "depth: %ld\n", pdepth);
+        // The distance above is rounded; this one can be compared exactly.
+        if (k == 1) {
+            fprintf(stderr, "distance: %.17g\n", closest_pairs.pairs[0].d);
+        }
+    }
+    heap_free(&closest_pairs);
+    if (trace_file != NULL) {
+        trace_finish(trace_file);
+    }
 
-    // Calculate the result using the parallel algorithm.
-    double result_p = closest_parallel(points_arr, n, pdepth, &pcount);
-    printf("The smallest distance: is %.2f (total worker processes: %d)\n", result_p, pcount);
+    unload_points(points_arr, n);
 
     exit(0);
 }
@@ -0,0 +1,617 @@
+/*
+ * Closest pair of a point file shared among worker processes that talk to
+ * a coordinator over sockets, so that no process holds all of the points.
+ *
+ * The coordinator samples the x coordinates of the file and cuts the x axis
+ * into one slab per worker. Each worker reads the file sequentially, keeps
+ * only the points of its slab and finds their closest pair. Once all of
+ * them have reported, the coordinator sends back the smallest distance d
+ * and each worker returns the points of its slab that are within d of a
+ * slab boundary. A pair closer than d that spans slabs has both of its
+ * points in this union of boundary strips, so the closest pair of the
+ * union, if closer than d, is the answer.
+ *
+ * The workers are started on this host by default. With -n the coordinator
+ * waits for workers started separately with -W, which only need to be able
+ * to open the same file path. The messages are raw structs, so the workers
+ * must be built for the same architecture, DIM and coordinate type.
+ *
+ * A conversation with a worker, in order:
+ *   coordinator -> worker  struct Assignment, then path_len bytes of path
+ *   worker -> coordinator  struct Report
+ *   coordinator -> worker  the smallest distance d, a double
+ *   worker -> coordinator  the strip size, an int, then its points
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "tuning.h"
+
+// Points of the file sampled per worker to place the slab boundaries
+#define SAMPLE_PER_WORKER 1024
+
+// Points read from the file at a time by a worker
+#define CHUNK 65536
+
+// Attempts a worker makes to connect before giving up, CONNECT_WAIT_US apart
+#define CONNECT_TRIES 50
+#define CONNECT_WAIT_US 100000
+
+// The part of the x axis given to a worker: lo <= x < hi, where a missing
+// bound is unbounded.
+struct Assignment {
+    coord_t lo, hi;
+    int has_lo, has_hi;
+    int slab;           // Position of the slab from the left
+    int path_len;       // Length of the file path that follows
+};
+
+struct Report {
+    struct Pair best;   // Closest pair of the slab, or d = DBL_MAX
+    int count;          // Number of points in the slab
+};
+
+
+void print_usage() {
+    fprintf(stderr, "Usage: dist_closest -f filename [-w workers] [-a address] [-n] [-t]\n");
+    fprintf(stderr, "       dist_closest -W address\n\n");
+    fprintf(stderr, "    -a Address to listen on: unix:path (default\n");
+    fprintf(stderr, "       unix:/tmp/dist_closest.<pid>) or tcp:host:port\n");
+    fprintf(stderr, "    -f File that contains the input points\n");
+    fprintf(stderr, "    -n Do not start local workers; wait for workers started with -W\n");
+    fprintf(stderr, "    -t Report the time spent in each phase on stderr\n");
+    fprintf(stderr, "    -w Number of workers (default 4)\n");
+    fprintf(stderr, "    -W Run a worker for the coordinator at address\n");
+
+    exit(1);
+}
+
+// Write exactly size bytes from buf to fd or exit.
+static void write_all(int fd, void *buf, size_t size) {
+    char *pos = buf;
+    while (size > 0) {
+        ssize_t written = write(fd, pos, size);
+        if (written == -1) {
+            perror("write to socket");
+            exit(1);
+        }
+        pos += written;
+        size -= written;
+    }
+}
+
+// Read exactly size bytes from fd into buf or exit.
+static void read_all(int fd, void *buf, size_t size) {
+    char *pos = buf;
+    while (size > 0) {
+        ssize_t num_read = read(fd, pos, size);
+        if (num_read == 0) {
+            fprintf(stderr, "Connection closed by the other side\n");
+            exit(1);
+        } else if (num_read == -1) {
+            perror("read from socket");
+            exit(1);
+        }
+        pos += num_read;
+        size -= num_read;
+    }
+}
+
+/*
+ * Fill *sa with the socket address for address, which is unix:path or
+ * tcp:host:port, and return its length. *family is set to its family.
+ */
+static socklen_t parse_address(char *address, struct sockaddr_storage *sa,
+                               int *family) {
+    memset(sa, 0, sizeof(*sa));
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un *un = (struct sockaddr_un *) sa;
+        char *path = address + 5;
+        if (strlen(path) == 0 || strlen(path) >= sizeof(un->sun_path)) {
+            fprintf(stderr, "Bad socket path in %s\n", address);
+            exit(1);
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, path);
+        *family = AF_UNIX;
+        return sizeof(struct sockaddr_un);
+    }
+
+    char *colon = strrchr(address, ':');
+    if (strncmp(address, "tcp:", 4) != 0 || colon == address + 3) {
+        fprintf(stderr, "Bad address %s: expected unix:path or tcp:host:port\n",
+                address);
+        exit(1);
+    }
+
+    char host[256];
+    size_t host_len = colon - (address + 4);
+    if (host_len == 0 || host_len >= sizeof(host)) {
+        fprintf(stderr, "Bad host in %s\n", address);
+        exit(1);
+    }
+    memcpy(host, address + 4, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(host, colon + 1, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", address, gai_strerror(err));
+        exit(1);
+    }
+    memcpy(sa, res->ai_addr, res->ai_addrlen);
+    socklen_t len = res->ai_addrlen;
+    *family = res->ai_family;
+    freeaddrinfo(res);
+    return len;
+}
+
+// Return a socket listening on address for up to backlog workers.
+static int listen_on(char *address, int backlog) {
+    struct sockaddr_storage sa;
+    int family;
+    socklen_t len = parse_address(address, &sa, &family);
+
+    int fd = socket(family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        exit(1);
+    }
+
+    if (family == AF_UNIX) {
+        // A socket file left behind by an earlier run would make bind fail.
+        unlink(((struct sockaddr_un *) &sa)->sun_path);
+    } else {
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1) {
+            perror("setsockopt");
+            exit(1);
+        }
+    }
+
+    if (bind(fd, (struct sockaddr *) &sa, len) == -1) {
+        perror(address);
+        exit(1);
+    }
+    if (listen(fd, backlog) == -1) {
+        perror("listen");
+        exit(1);
+    }
+    return fd;
+}
+
+// Return a socket connected to the coordinator at address, waiting for it
+// to start listening if needed.
+static int connect_to(char *address) {
+    struct sockaddr_storage sa;
+    int family;
+    socklen_t len = parse_address(address, &sa, &family);
+
+    for (int tries = 1; ; tries++) {
+        int fd = socket(family, SOCK_STREAM, 0);
+        if (fd == -1) {
+            perror("socket");
+            exit(1);
+        }
+        if (connect(fd, (struct sockaddr *) &sa, len) == 0) {
+            if (family != AF_UNIX) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            return fd;
+        }
+        if ((errno != ECONNREFUSED && errno != ENOENT) ||
+            tries == CONNECT_TRIES) {
+            perror(address);
+            exit(1);
+        }
+        close(fd);
+        usleep(CONNECT_WAIT_US);
+    }
+}
+
+// Return whether x lies in the slab of a.
+static inline int in_slab(struct Assignment *a, coord_t x) {
+    return (!a->has_lo || x >= a->lo) && (!a->has_hi || x < a->hi);
+}
+
+/*
+ * Read the points of the slab of a from the file f_name, a chunk at a time,
+ * and return them. *n is populated with their number.
+ */
+static struct Point *read_slab(char *f_name, struct Assignment *a, int *n) {
+    unsigned long total;
+    size_t header = read_header(f_name, &total);
+
+    FILE *fp = fopen(f_name, "rb");
+    if (fp == NULL) {
+        perror(f_name);
+        exit(1);
+    }
+    if (fseek(fp, header, SEEK_SET) == -1) {
+        perror("fseek");
+        exit(1);
+    }
+
+    struct Point *chunk = malloc(sizeof(struct Point) * CHUNK);
+    int capacity = CHUNK, count = 0;
+    struct Point *slab = malloc(sizeof(struct Point) * capacity);
+    if (chunk == NULL || slab == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (unsigned long done = 0; done < total; ) {
+        size_t want = total - done < CHUNK ? total - done : CHUNK;
+        if (fread(chunk, sizeof(struct Point), want, fp) != want) {
+            fprintf(stderr, "Error reading %s.\n", f_name);
+            exit(1);
+        }
+        done += want;
+
+        for (size_t i = 0; i < want; i++) {
+            if (!in_slab(a, chunk[i].x)) {
+                continue;
+            }
+            if (count == capacity) {
+                if (capacity > INT_MAX / 2) {
+                    fprintf(stderr, "The slab of worker %d holds more than "
+                            "%d points.\n", a->slab, INT_MAX);
+                    exit(1);
+                }
+                capacity *= 2;
+                slab = realloc(slab, sizeof(struct Point) * capacity);
+                if (slab == NULL) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            slab[count++] = chunk[i];
+        }
+    }
+
+    free(chunk);
+    fclose(fp);
+    *n = count;
+    return slab;
+}
+
+// Serve one coordinator at address as a worker.
+static void run_worker(char *address) {
+    int fd = connect_to(address);
+
+    struct Assignment a;
+    read_all(fd, &a, sizeof(a));
+    if (a.path_len <= 0 || a.path_len >= PATH_MAX) {
+        fprintf(stderr, "Bad path length %d from the coordinator\n",
+                a.path_len);
+        exit(1);
+    }
+    char *path = malloc(a.path_len + 1);
+    if (path == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    read_all(fd, path, a.path_len);
+    path[a.path_len] = '\0';
+
+    int n;
+    struct Point *p = read_slab(path, &a, &n);
+    sort_x(p, n);
+
+    struct Report r;
+    r.best = closest_serial(p, n);
+    r.count = n;
+    write_all(fd, &r, sizeof(r));
+
+    double d;
+    read_all(fd, &d, sizeof(d));
+
+    // The slab is sorted by x, so the strip is moved to its front in order.
+    int size = 0;
+    for (int i = 0; i < n; i++) {
+        if ((a.has_lo && COORD_GAP(p[i].x, a.lo) < d) ||
+            (a.has_hi && COORD_GAP(a.hi, p[i].x) < d)) {
+            p[size++] = p[i];
+        }
+    }
+    write_all(fd, &size, sizeof(int));
+    write_all(fd, p, sizeof(struct Point) * size);
+
+    close(fd);
+    free(p);
+    free(path);
+}
+
+static int compare_coord(const void *a, const void *b) {
+    coord_t x = *(coord_t *) a, y = *(coord_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Place the boundaries between num_workers slabs of the points of f_name at
+ * evenly spaced quantiles of a sample of their x coordinates. bounds[] gets
+ * num_workers - 1 boundaries in increasing order.
+ */
+static void place_bounds(char *f_name, int num_workers, coord_t *bounds) {
+    unsigned long total;
+    size_t header = read_header(f_name, &total);
+
+    unsigned long size = (unsigned long) num_workers * SAMPLE_PER_WORKER;
+    size = total < size ? total : size;
+    coord_t *sample = malloc(sizeof(coord_t) * size + 1);
+    if (sample == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    FILE *fp = fopen(f_name, "rb");
+    if (fp == NULL) {
+        perror(f_name);
+        exit(1);
+    }
+    for (unsigned long i = 0; i < size; i++) {
+        struct Point p;
+        long pos = header + (i * total / size) * sizeof(struct Point);
+        if (fseek(fp, pos, SEEK_SET) == -1 ||
+            fread(&p, sizeof(struct Point), 1, fp) != 1) {
+            fprintf(stderr, "Error reading %s.\n", f_name);
+            exit(1);
+        }
+        sample[i] = p.x;
+    }
+    fclose(fp);
+
+    qsort(sample, size, sizeof(coord_t), compare_coord);
+    for (int i = 1; i < num_workers; i++) {
+        bounds[i - 1] = size > 0 ? sample[i * size / num_workers] : 0;
+    }
+    free(sample);
+}
+
+// Start a worker for the coordinator at address in a child process.
+static int spawn_worker(char *address, int listen_fd) {
+    int pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        close(listen_fd);
+        run_worker(address);
+        exit(0);
+    }
+    return pid;
+}
+
+/*
+ * Find the closest pair of the points of f_name with num_workers workers
+ * connecting to address. Unless spawn is 0, the workers are forked here.
+ */
+static struct Pair run_coordinator(char *f_name, int num_workers,
+                                   char *address, int spawn, int timing) {
+    int listen_fd = listen_on(address, num_workers);
+    double start = get_time();
+
+    int *pids = malloc(sizeof(int) * num_workers);
+    int *fds = malloc(sizeof(int) * num_workers);
+    coord_t *bounds = malloc(sizeof(coord_t) * num_workers);
+    if (pids == NULL || fds == NULL || bounds == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    // Sampling also checks the file before any worker is started.
+    place_bounds(f_name, num_workers, bounds);
+    double sampled = get_time();
+
+    if (spawn) {
+        for (int i = 0; i < num_workers; i++) {
+            pids[i] = spawn_worker(address, listen_fd);
+        }
+    } else {
+        fprintf(stderr, "Waiting for %d workers on %s\n", num_workers, address);
+    }
+
+    // Workers get their slabs in the order they connect.
+    char *path = realpath(f_name, NULL);
+    if (path == NULL) {
+        perror(f_name);
+        exit(1);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        fds[i] = accept(listen_fd, NULL, NULL);
+        if (fds[i] == -1) {
+            perror("accept");
+            exit(1);
+        }
+
+        struct Assignment a;
+        memset(&a, 0, sizeof(a));
+        a.has_lo = i > 0;
+        a.has_hi = i < num_workers - 1;
+        a.lo = a.has_lo ? bounds[i - 1] : 0;
+        a.hi = a.has_hi ? bounds[i] : 0;
+        a.slab = i;
+        a.path_len = strlen(path);
+        write_all(fds[i], &a, sizeof(a));
+        write_all(fds[i], path, a.path_len);
+    }
+    close(listen_fd);
+
+    struct Pair best;
+    best.d = DBL_MAX;
+    long total = 0;
+    for (int i = 0; i < num_workers; i++) {
+        struct Report r;
+        read_all(fds[i], &r, sizeof(r));
+        best = min_pair(best, r.best);
+        total += r.count;
+    }
+    double solved = get_time();
+
+    // Gather the boundary strips into one array.
+    int capacity = 1024, size = 0;
+    struct Point *strip = malloc(sizeof(struct Point) * capacity);
+    if (strip == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        int count;
+        write_all(fds[i], &best.d, sizeof(double));
+        read_all(fds[i], &count, sizeof(int));
+        if (count < 0 || count > INT_MAX - size) {
+            fprintf(stderr, "Bad strip size %d from worker %d\n", count, i);
+            exit(1);
+        }
+        if (size + count > capacity) {
+            while (size + count > capacity) {
+                capacity = capacity > INT_MAX / 2 ? INT_MAX : capacity * 2;
+            }
+            strip = realloc(strip, sizeof(struct Point) * capacity);
+            if (strip == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        read_all(fds[i], strip + size, sizeof(struct Point) * count);
+        size += count;
+        close(fds[i]);
+    }
+    double gathered = get_time();
+
+    sort_x(strip, size);
+    best = min_pair(best, closest_serial(strip, size));
+    double merged = get_time();
+
+    if (spawn) {
+        for (int i = 0; i < num_workers; i++) {
+            int status;
+            if (waitpid(pids[i], &status, 0) == -1) {
+                perror("waitpid");
+                exit(1);
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "A worker process failed\n");
+                exit(1);
+            }
+        }
+    }
+    if (strncmp(address, "unix:", 5) == 0) {
+        unlink(address + 5);
+    }
+
+    if (timing) {
+        fprintf(stderr, "sample: %.6f s\n", sampled - start);
+        fprintf(stderr, "slabs: %.6f s\n", solved - sampled);
+        fprintf(stderr, "strips: %.6f s\n", gathered - solved);
+        fprintf(stderr, "merge: %.6f s\n", merged - gathered);
+        fprintf(stderr, "points: %ld, strip points: %d\n", total, size);
+    }
+
+    free(strip);
+    free(path);
+    free(bounds);
+    free(fds);
+    free(pids);
+    // Positions within a slab or the strip say nothing about the file.
+    best.i1 = best.i2 = -1;
+    return best;
+}
+
+int main(int argc, char **argv) {
+    char *filename = NULL;
+    char *address = NULL;
+    char *worker_address = NULL;
+    char default_address[64];
+    int num_workers = 4;
+    int spawn = 1;
+    int timing = 0;
+    struct Tuning tuning;
+
+    if (argc < 2) {
+        print_usage();
+    }
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:f:ntw:W:")) != -1) {
+        switch (opt) {
+            case 'a':
+                address = optarg;
+                break;
+            case 'f':
+                filename = optarg;
+                break;
+            case 'n':
+                spawn = 0;
+                break;
+            case 't':
+                timing = 1;
+                break;
+            case 'w': {
+                char *endptr;
+                num_workers = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || num_workers < 1) {
+                    print_usage();
+                }
+                break;
+            }
+            case 'W':
+                worker_address = optarg;
+                break;
+            case '?':
+            default:
+                print_usage();
+        }
+    }
+
+    // A worker that dies must not take the coordinator down with SIGPIPE;
+    // the failed write is reported instead.
+    signal(SIGPIPE, SIG_IGN);
+
+    load_tuning(&tuning);
+    apply_tuning(&tuning);
+
+    if (worker_address != NULL) {
+        run_worker(worker_address);
+        exit(0);
+    }
+
+    if (!filename) {
+        print_usage();
+    }
+    if (address == NULL) {
+        snprintf(default_address, sizeof(default_address),
+                 "unix:/tmp/dist_closest.%d", (int) getpid());
+        address = default_address;
+    }
+
+    struct Pair best = run_coordinator(filename, num_workers, address, spawn,
+                                       timing);
+    printf("The smallest distance: is %.2f (total worker processes: %d)\n",
+           best.d, num_workers);
+
+    exit(0);
+}
@@ -0,0 +1,313 @@
+/*
+ * Closest pair maintenance under insertions and deletions.
+ *
+ * The points live in a hashed grid whose cells are at least twice as wide
+ * as the current closest distance d. Inserting a point compares it with
+ * the points in the 2x2 block of cells nearest to it, which holds every
+ * point within d, so the closest pair is updated in expected O(1) time.
+ * When d has shrunk enough that the cells are more than eight times as wide
+ * as d, the grid is rebuilt with smaller cells.
+ *
+ * Deleting a point that is not part of the closest pair cannot change d.
+ * Deleting one that is marks the pair as stale, and the next query
+ * recomputes it from scratch with the divide-and-conquer algorithm. For a
+ * batch of random updates this is rare, and it happens at most once per
+ * batch however many deletions hit the pair.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "dynamic_closest.h"
+
+
+/*
+ * next[] value of a slot that holds no point and is followed by slot in the
+ * free list (-1 ends the list). The values are all below -1, the end of a
+ * cell's chain, so the free list shares next[] with the cells. FREE_LINK
+ * is its own inverse, so it also turns such a value back into the slot.
+ */
+#define FREE_LINK(slot) (-3 - (slot))
+#define IS_FREE(s, slot) ((s)->next[slot] < -1)
+
+static inline unsigned long cell_key(long cx, long cy) {
+    return (unsigned long) (unsigned int) cx << 32 | (unsigned int) cy;
+}
+
+// Return the cell with the given key, or the empty slot where it belongs.
+static struct dyn_cell *find_cell(struct DynamicSet *s, unsigned long key) {
+    int slot = (key * 0x9e3779b97f4a7c15UL >> 32) & s->mask;
+
+    while (s->cells[slot].used && s->cells[slot].key != key) {
+        slot = (slot + 1) & s->mask;
+    }
+    return &s->cells[slot];
+}
+
+// Return the cell side the grid should have for the current closest pair.
+static double target_side(struct DynamicSet *s) {
+    return cell_side(s->best.d, s->extent);
+}
+
+/*
+ * Populate *fx and *fy with the position of p in cells from the corner of
+ * the box. Return 0 if p is too far outside the box for its cell to be
+ * numbered.
+ */
+static int cell_coords(struct DynamicSet *s, struct Point p, double *fx,
+                       double *fy) {
+    *fx = COORD_DIFF(p.x, s->ox) * s->scale;
+    *fy = COORD_DIFF(p.y, s->oy) * s->scale;
+    return fabs(*fx) < 2.0 * CELLS_MAX && fabs(*fy) < 2.0 * CELLS_MAX;
+}
+
+// Link the point in slot, which must be in range of the cells, into its cell.
+static void link_slot(struct DynamicSet *s, int slot) {
+    double fx, fy;
+    cell_coords(s, s->points[slot], &fx, &fy);
+    unsigned long key = cell_key(floor(fx), floor(fy));
+    struct dyn_cell *c = find_cell(s, key);
+
+    if (!c->used) {
+        c->key = key;
+        c->head = -1;
+        c->used = 1;
+        s->cells_used++;
+    }
+    s->next[slot] = c->head;
+    c->head = slot;
+}
+
+/*
+ * Rebuild the grid around the bounding box of the points, with cells twice
+ * as wide as the current closest distance (or wider, see cell_side()) and
+ * enough slots for twice as many cells as points.
+ */
+static void rebuild(struct DynamicSet *s) {
+    coord_t max_x = 0, max_y = 0;
+    int first = 1;
+
+    s->ox = s->oy = 0;
+    for (int i = 0; i < s->used; i++) {
+        if (IS_FREE(s, i)) {
+            continue;
+        }
+        struct Point p = s->points[i];
+        if (first || p.x < s->ox) {
+            s->ox = p.x;
+        }
+        if (first || p.x > max_x) {
+            max_x = p.x;
+        }
+        if (first || p.y < s->oy) {
+            s->oy = p.y;
+        }
+        if (first || p.y > max_y) {
+            max_y = p.y;
+        }
+        first = 0;
+    }
+    s->extent = first ? 0 : fmax(COORD_DIFF(max_x, s->ox),
+                                 COORD_DIFF(max_y, s->oy));
+    double side = target_side(s);
+
+    int slots = 16;
+    while (slots < 2 * s->count) {
+        slots *= 2;
+    }
+    free(s->cells);
+    s->cells = calloc(slots, sizeof(struct dyn_cell));
+    if (s->cells == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    s->mask = slots - 1;
+    s->cells_used = 0;
+    s->scale = 1 / side;
+
+    for (int i = 0; i < s->used; i++) {
+        if (!IS_FREE(s, i)) {
+            link_slot(s, i);
+        }
+    }
+}
+
+// Recompute the closest pair from scratch and rebuild the grid around it.
+static void recompute(struct DynamicSet *s) {
+    struct Point *p = malloc(sizeof(struct Point) * (s->count > 0 ? s->count : 1));
+    int *slots = malloc(sizeof(int) * (s->count > 0 ? s->count : 1));
+    if (p == NULL || slots == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    int n = 0;
+    for (int i = 0; i < s->used; i++) {
+        if (!IS_FREE(s, i)) {
+            slots[n] = i;
+            p[n++] = s->points[i];
+        }
+    }
+    sort_x_ids(p, slots, n);
+    s->best = closest_serial(p, n);
+    if (s->best.i1 != -1) {
+        s->best.i1 = slots[s->best.i1];
+        s->best.i2 = slots[s->best.i2];
+    }
+    s->stale = 0;
+    s->recomputes++;
+    free(p);
+    free(slots);
+
+    rebuild(s);
+}
+
+// Build a set holding the n points of p[].
+void dynamic_init(struct DynamicSet *s, struct Point *p, int n) {
+    s->capacity = n > 16 ? n : 16;
+    s->points = malloc(sizeof(struct Point) * s->capacity);
+    s->next = malloc(sizeof(int) * s->capacity);
+    if (s->points == NULL || s->next == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        s->points[i] = p[i];
+        s->next[i] = -1;
+    }
+    s->used = s->count = n;
+    s->free_slot = -1;
+    s->cells = NULL;
+
+    recompute(s);
+    s->recomputes = 0;  // Only count the ones caused by deletions
+}
+
+void dynamic_free(struct DynamicSet *s) {
+    free(s->points);
+    free(s->next);
+    free(s->cells);
+}
+
+// Add p to the set, updating the closest pair.
+void dynamic_insert(struct DynamicSet *s, struct Point p) {
+    int slot;
+
+    if (s->free_slot != -1) {
+        slot = s->free_slot;
+        s->free_slot = FREE_LINK(s->next[slot]);
+    } else {
+        if (s->used == s->capacity) {
+            s->capacity *= 2;
+            s->points = realloc(s->points, sizeof(struct Point) * s->capacity);
+            s->next = realloc(s->next, sizeof(int) * s->capacity);
+            if (s->points == NULL || s->next == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        slot = s->used++;
+    }
+    s->points[slot] = p;
+    s->next[slot] = -1;
+    s->count++;
+
+    // With fewer than two points before this one there is no grid bound to
+    // rely on, so just let the next query compute the pair.
+    if (s->best.d == DBL_MAX) {
+        s->stale = 1;
+    }
+
+    // The cells are numbered from the box of the points at the last
+    // rebuild; a point far outside it needs a new box.
+    double fx, fy;
+    if (cell_coords(s, p, &fx, &fy)) {
+        link_slot(s, slot);
+    } else {
+        rebuild(s);
+        cell_coords(s, p, &fx, &fy);
+    }
+
+    // While stale, the next query recomputes everything anyway.
+    if (!s->stale) {
+        long cx = floor(fx), cy = floor(fy);
+        long xs[2] = {cx, fx - cx < 0.5 ? cx - 1 : cx + 1};
+        long ys[2] = {cy, fy - cy < 0.5 ? cy - 1 : cy + 1};
+
+        for (int a = 0; a < 2; a++) {
+            for (int b = 0; b < 2; b++) {
+                struct dyn_cell *c = find_cell(s, cell_key(xs[a], ys[b]));
+                if (!c->used) {
+                    continue;
+                }
+                for (int j = c->head; j != -1; j = s->next[j]) {
+                    if (j != slot && dist(p, s->points[j]) < s->best.d) {
+                        s->best.d = dist(p, s->points[j]);
+                        s->best.p1 = s->points[j];
+                        s->best.p2 = p;
+                        s->best.i1 = j;
+                        s->best.i2 = slot;
+                    }
+                }
+            }
+        }
+    }
+
+    // Keep the cells sparse and the table at most half full.
+    if ((!s->stale && target_side(s) * 4 * s->scale < 1) ||
+        s->cells_used * 2 > s->mask) {
+        rebuild(s);
+    }
+}
+
+/*
+ * Remove one point with the coordinates of p from the set. Return 0 on
+ * success and -1 if there is no such point.
+ */
+int dynamic_delete(struct DynamicSet *s, struct Point p) {
+    double fx, fy;
+    if (!cell_coords(s, p, &fx, &fy)) {
+        return -1;      // Every point of the set is in range
+    }
+    struct dyn_cell *c = find_cell(s, cell_key(floor(fx), floor(fy)));
+    if (!c->used) {
+        return -1;
+    }
+
+    int prev = -1, slot;
+    for (slot = c->head; slot != -1; prev = slot, slot = s->next[slot]) {
+        if (same_point(s->points[slot], p)) {
+            break;
+        }
+    }
+    if (slot == -1) {
+        return -1;
+    }
+
+    if (prev == -1) {
+        c->head = s->next[slot];
+    } else {
+        s->next[prev] = s->next[slot];
+    }
+    s->next[slot] = FREE_LINK(s->free_slot);
+    s->free_slot = slot;
+    s->count--;
+
+    if (same_point(p, s->best.p1) || same_point(p, s->best.p2)) {
+        s->stale = 1;
+    }
+    return 0;
+}
+
+// Return the closest pair of the set, recomputing it if it is stale.
+struct Pair dynamic_closest(struct DynamicSet *s) {
+    if (s->stale) {
+        recompute(s);
+    }
+    return s->best;
+}
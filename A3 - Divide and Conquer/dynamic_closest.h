@@ -0,0 +1,44 @@
+#ifndef _DYNAMIC_CLOSEST_H
+#define _DYNAMIC_CLOSEST_H
+
+// One occupied cell of the grid and the chain of points in it.
+struct dyn_cell {
+    unsigned long key;
+    int head;           // First slot in the cell, or -1 if it emptied
+    int used;
+};
+
+/*
+ * A set of points that supports insertions and deletions while keeping
+ * track of its closest pair. The points are stored in slots chained by the
+ * grid cell they fall in; the cells are at least twice as wide as the
+ * closest pair, so a new point only has to be compared with the 2x2 block
+ * of cells nearest to it.
+ */
+struct DynamicSet {
+    struct Point *points;   // Slots holding the points
+    int *next;              // Next slot in the same cell or free list
+    int capacity;
+    int used;               // Slots handed out so far
+    int free_slot;          // First free slot below used, or -1
+    int count;              // Number of points in the set
+
+    struct dyn_cell *cells;
+    int mask;               // Number of cell slots - 1 (a power of 2)
+    int cells_used;
+    double scale;           // 1 / side of a cell
+    coord_t ox, oy;         // Corner of the box where cell 0 starts
+    double extent;          // Width of the box of the points at the rebuild
+
+    struct Pair best;       // The closest pair and its slots, unless stale
+    int stale;              // A point of best has been deleted
+    int recomputes;         // Full recomputations caused by deletions
+};
+
+void dynamic_init(struct DynamicSet *s, struct Point *p, int n);
+void dynamic_free(struct DynamicSet *s);
+void dynamic_insert(struct DynamicSet *s, struct Point p);
+int dynamic_delete(struct DynamicSet *s, struct Point p);
+struct Pair dynamic_closest(struct DynamicSet *s);
+
+#endif /* _DYNAMIC_CLOSEST_H */
@@ -0,0 +1,425 @@
+/*
+ * Closest pair of a point file that need not fit in memory.
+ *
+ * The file is sorted by x externally: it is read sequentially in runs that
+ * fit in the memory budget, each run is sorted and appended to a temporary
+ * file, and the runs are merged. If there are too many runs to merge at
+ * once with reasonably large buffers, groups of them are first merged into
+ * longer runs in another temporary file.
+ *
+ * The last merge is not written out. Its output is cut into slabs of
+ * consecutive points, which are solved one at a time with closest_serial().
+ * A pair closer than the best so far that spans slabs has its left point
+ * within the best distance of the right end of the points before it, so
+ * those points are carried from slab to slab and checked against the start
+ * of each new slab with strip_closest().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "external_closest.h"
+
+// Smallest buffer, in points, given to each run being merged
+#define MIN_RUN_BUFFER 1024
+
+
+// A sorted run in a temporary file.
+struct run {
+    off_t start;            // Offset of its first point
+    unsigned long count;
+};
+
+// Reads one run a buffer at a time.
+struct cursor {
+    int fd;
+    off_t next;             // Offset of the first point not yet read
+    unsigned long left;     // Points not yet read
+    struct Point *buf;
+    int pos, len;           // Next point in buf and number of points in buf
+    int cap;
+};
+
+// The merge of several runs: a min-heap of cursors by their next x.
+struct merger {
+    struct cursor *cursors;
+    int *heap;
+    int size;
+};
+
+// Read exactly size bytes at offset of fd into buf, or exit.
+static void pread_full(int fd, void *buf, size_t size, off_t offset) {
+    char *pos = buf;
+    while (size > 0) {
+        ssize_t num_read = pread(fd, pos, size, offset);
+        if (num_read <= 0) {
+            if (num_read == -1) {
+                perror("pread");
+            } else {
+                fprintf(stderr, "Unexpected end of file\n");
+            }
+            exit(1);
+        }
+        pos += num_read;
+        size -= num_read;
+        offset += num_read;
+    }
+}
+
+// Write exactly size bytes from buf to fd, or exit.
+static void write_full(int fd, void *buf, size_t size) {
+    char *pos = buf;
+    while (size > 0) {
+        ssize_t written = write(fd, pos, size);
+        if (written == -1) {
+            perror("write to temporary file");
+            exit(1);
+        }
+        pos += written;
+        size -= written;
+    }
+}
+
+static void *alloc(size_t size) {
+    void *mem = malloc(size);
+    if (mem == NULL && size > 0) {
+        perror("malloc");
+        exit(1);
+    }
+    return mem;
+}
+
+/*
+ * Return a temporary file in $TMPDIR, or /tmp if it is not set. The file is
+ * unlinked at once, so it goes away when it is closed.
+ */
+static int temp_file() {
+    char *dir = getenv("TMPDIR");
+    if (dir == NULL || dir[0] == '\0') {
+        dir = "/tmp";
+    }
+    char *path = alloc(strlen(dir) + strlen("/closest.XXXXXX") + 1);
+    sprintf(path, "%s/closest.XXXXXX", dir);
+
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    unlink(path);
+    free(path);
+    return fd;
+}
+
+/*
+ * Read the total points after the header of the file in_fd, sort them by x
+ * in runs of up to run_points points and write the runs to out_fd. Return
+ * the runs and populate *num_runs with their number.
+ */
+static struct run *form_runs(int in_fd, size_t header, unsigned long total,
+                             int run_points, int out_fd, int *num_runs) {
+    int count = (total + run_points - 1) / run_points;
+    struct run *runs = alloc(sizeof(struct run) * count + 1);
+    struct Point *buf = alloc(sizeof(struct Point) * run_points);
+
+    off_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned long done = (unsigned long) i * run_points;
+        int n = total - done < (unsigned long) run_points ? total - done
+                                                           : run_points;
+        pread_full(in_fd, buf, sizeof(struct Point) * n,
+                   header + done * sizeof(struct Point));
+        sort_x(buf, n);
+        write_full(out_fd, buf, sizeof(struct Point) * n);
+
+        runs[i].start = offset;
+        runs[i].count = n;
+        offset += (off_t) n * sizeof(struct Point);
+    }
+
+    free(buf);
+    *num_runs = count;
+    return runs;
+}
+
+// Fill the buffer of c from its run. Return 0 if the run is exhausted.
+static int refill(struct cursor *c) {
+    if (c->left == 0) {
+        return 0;
+    }
+    c->len = c->left < (unsigned long) c->cap ? c->left : c->cap;
+    pread_full(c->fd, c->buf, sizeof(struct Point) * c->len, c->next);
+    c->next += (off_t) c->len * sizeof(struct Point);
+    c->left -= c->len;
+    c->pos = 0;
+    return 1;
+}
+
+static inline coord_t next_x(struct merger *m, int i) {
+    struct cursor *c = &m->cursors[m->heap[i]];
+    return c->buf[c->pos].x;
+}
+
+// Restore the heap order from position i down.
+static void sift_down(struct merger *m, int i) {
+    for (;;) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < m->size && next_x(m, l) < next_x(m, smallest)) {
+            smallest = l;
+        }
+        if (r < m->size && next_x(m, r) < next_x(m, smallest)) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            return;
+        }
+        int tmp = m->heap[i];
+        m->heap[i] = m->heap[smallest];
+        m->heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/*
+ * Start merging the count runs of runs[] in the file fd, reading each of
+ * them buffer_points points at a time.
+ */
+static void merger_init(struct merger *m, int fd, struct run *runs, int count,
+                        int buffer_points) {
+    m->cursors = alloc(sizeof(struct cursor) * count);
+    m->heap = alloc(sizeof(int) * count);
+    m->size = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct cursor *c = &m->cursors[i];
+        c->fd = fd;
+        c->next = runs[i].start;
+        c->left = runs[i].count;
+        c->cap = buffer_points;
+        c->buf = alloc(sizeof(struct Point) * buffer_points);
+        if (refill(c)) {
+            m->heap[m->size++] = i;
+        }
+    }
+    for (int i = m->size / 2 - 1; i >= 0; i--) {
+        sift_down(m, i);
+    }
+}
+
+// Store the next point of the merge in *p. Return 0 once all are merged.
+static int merger_next(struct merger *m, struct Point *p) {
+    if (m->size == 0) {
+        return 0;
+    }
+
+    struct cursor *c = &m->cursors[m->heap[0]];
+    *p = c->buf[c->pos++];
+    if (c->pos == c->len && !refill(c)) {
+        m->heap[0] = m->heap[--m->size];
+    }
+    sift_down(m, 0);
+    return 1;
+}
+
+static void merger_free(struct merger *m, int count) {
+    for (int i = 0; i < count; i++) {
+        free(m->cursors[i].buf);
+    }
+    free(m->cursors);
+    free(m->heap);
+}
+
+/*
+ * Merge groups of fan_in runs of *runs in the file *fd into a new
+ * temporary file until there are at most fan_in runs left, so that they
+ * can be merged at once. Return the number of passes made.
+ */
+static int merge_passes(int *fd, struct run **runs, int *num_runs, int fan_in,
+                        size_t buffer_bytes) {
+    int passes = 0;
+
+    while (*num_runs > fan_in) {
+        int out_fd = temp_file();
+        int groups = (*num_runs + fan_in - 1) / fan_in;
+        struct run *merged = alloc(sizeof(struct run) * groups);
+        int buffer_points = buffer_bytes / ((fan_in + 1) * sizeof(struct Point));
+        struct Point *out = alloc(sizeof(struct Point) * buffer_points);
+        off_t offset = 0;
+
+        for (int g = 0; g < groups; g++) {
+            int first = g * fan_in;
+            int count = *num_runs - first < fan_in ? *num_runs - first : fan_in;
+            struct merger m;
+            merger_init(&m, *fd, *runs + first, count, buffer_points);
+
+            merged[g].start = offset;
+            merged[g].count = 0;
+            int len = 0;
+            while (merger_next(&m, &out[len])) {
+                if (++len == buffer_points) {
+                    write_full(out_fd, out, sizeof(struct Point) * len);
+                    len = 0;
+                }
+                merged[g].count++;
+            }
+            write_full(out_fd, out, sizeof(struct Point) * len);
+            offset += (off_t) merged[g].count * sizeof(struct Point);
+            merger_free(&m, count);
+        }
+
+        free(out);
+        free(*runs);
+        close(*fd);
+        *fd = out_fd;
+        *runs = merged;
+        *num_runs = groups;
+        passes++;
+    }
+    return passes;
+}
+
+// Append p to the array *a of *n points and *cap capacity, growing it.
+static void append(struct Point **a, int *n, int *cap, struct Point p) {
+    if (*n == *cap) {
+        if (*cap > INT_MAX / 2) {
+            fprintf(stderr, "The strip between slabs holds more than %d "
+                    "points.\n", INT_MAX);
+            exit(1);
+        }
+        *cap = *cap * 2;
+        *a = realloc(*a, sizeof(struct Point) * *cap);
+        if (*a == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    (*a)[(*n)++] = p;
+}
+
+/*
+ * Find the closest pair of the points of the file f_name using at most about
+ * budget bytes of memory for points, besides the points carried between
+ * slabs. A run and the scratch space to sort it take half of the budget,
+ * as do the buffers of a merge, and a slab and its strips less than half.
+ * With timing set, the time spent in each phase goes to stderr. The
+ * positions of the pair are not tracked.
+ */
+struct Pair closest_external(char *f_name, size_t budget, int timing) {
+    double start = get_time();
+    unsigned long total;
+    size_t header = read_header(f_name, &total);
+
+    int in_fd = open(f_name, O_RDONLY);
+    if (in_fd == -1) {
+        perror(f_name);
+        exit(1);
+    }
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // A run is sorted with a scratch array of the same size; a slab needs
+    // room for the strips of closest_serial() as well. Neither needs to be
+    // larger than the file.
+    size_t points = budget / sizeof(struct Point);
+    unsigned long limit = total > 0 && total < INT_MAX ? total : INT_MAX;
+    int run_points = points / 4 < limit ? points / 4 : limit;
+    int slab_points = points / 8 < limit ? points / 8 : limit;
+    int fan_in = budget / 2 / (MIN_RUN_BUFFER * sizeof(struct Point));
+
+    int fd = temp_file();
+    int num_runs;
+    struct run *runs = form_runs(in_fd, header, total, run_points, fd,
+                                 &num_runs);
+    close(in_fd);
+    int initial_runs = num_runs;
+    double sorted = get_time();
+
+    int passes = merge_passes(&fd, &runs, &num_runs, fan_in, budget / 2);
+    double merged = get_time();
+
+    // The last merge feeds the slabs directly.
+    struct merger m;
+    int buffer_points = budget / 2 / ((num_runs + 1) * sizeof(struct Point));
+    merger_init(&m, fd, runs, num_runs, buffer_points);
+
+    struct Point *slab = alloc(sizeof(struct Point) * slab_points);
+    int carried_cap = 1024, carried_n = 0, cross_cap = 1024;
+    struct Point *carried = alloc(sizeof(struct Point) * carried_cap);
+    struct Point *cross = alloc(sizeof(struct Point) * cross_cap);
+    int widest = 0;
+    struct Pair best;
+    best.d = DBL_MAX;
+
+    for (;;) {
+        int n = 0;
+        while (n < slab_points && merger_next(&m, &slab[n])) {
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        best = min_pair(best, closest_serial(slab, n));
+
+        // Check the carried points against the start of this slab. The
+        // copy is needed because strip_closest() sorts it by y.
+        if (carried_n > 0) {
+            coord_t reach = carried[carried_n - 1].x;
+            int cross_n = 0;
+            for (int i = 0; i < carried_n; i++) {
+                append(&cross, &cross_n, &cross_cap, carried[i]);
+            }
+            for (int i = 0; i < n && COORD_DIFF(slab[i].x, reach) < best.d; i++) {
+                append(&cross, &cross_n, &cross_cap, slab[i]);
+            }
+            best = strip_closest(cross, NULL, cross_n, carried_n, best);
+        }
+
+        // Carry the points within best.d of the end of this slab, from the
+        // old carried points and then from the slab, keeping them in x order.
+        coord_t end = slab[n - 1].x;
+        int kept = 0;
+        for (int i = 0; i < carried_n; i++) {
+            if (COORD_DIFF(end, carried[i].x) < best.d) {
+                carried[kept++] = carried[i];
+            }
+        }
+        carried_n = kept;
+        int first = n;
+        while (first > 0 && COORD_DIFF(end, slab[first - 1].x) < best.d) {
+            first--;
+        }
+        for (int i = first; i < n; i++) {
+            append(&carried, &carried_n, &carried_cap, slab[i]);
+        }
+        widest = carried_n > widest ? carried_n : widest;
+    }
+    double solved = get_time();
+
+    merger_free(&m, num_runs);
+    close(fd);
+    free(runs);
+    free(slab);
+    free(carried);
+    free(cross);
+
+    if (timing) {
+        fprintf(stderr, "runs: %.6f s (%d runs of up to %d points)\n",
+                sorted - start, initial_runs, run_points);
+        fprintf(stderr, "merge passes: %.6f s (%d passes)\n", merged - sorted,
+                passes);
+        fprintf(stderr, "slabs: %.6f s (slabs of up to %d points, widest "
+                "strip %d points)\n", solved - merged, slab_points, widest);
+    }
+    // Positions within a slab say nothing about the file.
+    best.i1 = best.i2 = -1;
+    return best;
+}
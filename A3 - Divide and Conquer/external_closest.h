@@ -0,0 +1,9 @@
+#ifndef _EXTERNAL_CLOSEST_H
+#define _EXTERNAL_CLOSEST_H
+
+// Smallest memory budget that closest_external() accepts, in bytes
+#define EXTERNAL_MIN_BUDGET (1 << 20)
+
+struct Pair closest_external(char *f_name, size_t budget, int timing);
+
+#endif /* _EXTERNAL_CLOSEST_H */
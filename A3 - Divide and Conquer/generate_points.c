@@ -1,51 +1,310 @@
 #include <stdio.h>
 #include <stdlib.h> 
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "point.h"
 
+/* Points are generated and written in chunks of this many points, so memory
+ * use is bounded by the number of threads rather than by the number of
+ * points. Each chunk has its own random stream derived from the seed and
+ * the chunk number, so the output does not depend on the number of threads.
+ */
+#define CHUNK_POINTS 65536
 
-int main(int argc, char *argv[]) {
-    struct Point *p;
-    FILE *f;
-    int n, bytes_written;
+// Number of cluster centres for the clustered distribution
+#define NUM_CLUSTERS 64
 
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s filename total_points\n", argv[0]);
-        exit(1);
+#if DIM == 2
+#define COORD_NAMES "x- and y-coordinate"
+#elif DIM == 3
+#define COORD_NAMES "x-, y- and z-coordinate"
+#else
+#define COORD_NAMES "x-, y-, z- and w-coordinate"
+#endif
+
+enum distribution { UNIFORM, CLUSTER, GAUSSIAN, GRID, DUPLICATE };
+
+static char *dist_names[] = {"uniform", "cluster", "gaussian", "grid", "dup"};
+
+// Settings shared by all the generator threads.
+struct generator {
+    int fd;
+    long n;
+    enum distribution dist;
+    unsigned long seed;
+    int num_threads;
+    int grid_side;      // Points along each axis for the grid distribution
+    long pool_size;     // Distinct points for the duplicate distribution
+    size_t header_size; // Bytes before the first point
+};
+
+struct worker {
+    struct generator *gen;
+    int id;
+};
+
+/* splitmix64: a small, fast generator whose state can be seeded directly
+ * from (seed, stream number) with no warm-up.
+ */
+static unsigned long next_random(unsigned long *state) {
+    unsigned long z = (*state += 0x9e3779b97f4a7c15UL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+    return z ^ (z >> 31);
+}
+
+// Return a coordinate uniformly distributed between 0 and COORD_MAX.
+static coord_t random_coord(unsigned long *state) {
+#if COORD_TYPE == COORD_INT32
+    return next_random(state) % ((unsigned long) RAND_MAX + 1);
+#elif COORD_TYPE == COORD_INT64
+    return next_random(state) >> 2;
+#else
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0) * COORD_MAX;
+#endif
+}
+
+// Return a standard normal sample (Box-Muller).
+static double random_normal(unsigned long *state) {
+    double u1 = (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+    double u2 = (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+    return sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+}
+
+// Clamp v to the coordinate range of the uniform distribution.
+static coord_t clamp_coord(double v) {
+    if (v < 0) {
+        return 0;
+    }
+    if (v >= COORD_MAX) {
+        return COORD_MAX;
+    }
+    return (coord_t) v;
+}
+
+/* Return the uniformly random point number i of a stream that is
+ * independent of the per-chunk streams. Used for the cluster centres and
+ * the duplicate pool so that every thread sees the same values without
+ * storing them.
+ */
+static struct Point fixed_point(unsigned long seed, unsigned long i) {
+    unsigned long state = ~seed * 0x2545f4914f6cdd1dUL + i;
+    struct Point p;
+    for (int k = 0; k < DIM; k++) {
+        COORD(p, k) = random_coord(&state);
     }
+    return p;
+}
+
+// Fill p[] with the count points starting at index first.
+static void fill_chunk(struct generator *gen, struct Point *p, long first,
+                       int count) {
+    unsigned long state = gen->seed * 0x100000001b3UL + first / CHUNK_POINTS;
+
+    for (int i = 0; i < count; i++) {
+        switch (gen->dist) {
+        case UNIFORM:
+            for (int k = 0; k < DIM; k++) {
+                COORD(p[i], k) = random_coord(&state);
+            }
+            break;
+        case CLUSTER: {
+            struct Point c = fixed_point(gen->seed,
+                                         next_random(&state) % NUM_CLUSTERS);
+            double sigma = COORD_MAX / 1000.0;
+            for (int k = 0; k < DIM; k++) {
+                COORD(p[i], k) = clamp_coord(COORD(c, k) +
+                                             sigma * random_normal(&state));
+            }
+            break;
+        }
+        case GAUSSIAN: {
+            double sigma = COORD_MAX / 8.0;
+            for (int k = 0; k < DIM; k++) {
+                COORD(p[i], k) = clamp_coord(COORD_MAX / 2.0 +
+                                             sigma * random_normal(&state));
+            }
+            break;
+        }
+        case GRID: {
+            // Point number first + i written in base grid_side gives its
+            // position along each axis.
+            coord_t spacing = COORD_MAX / gen->grid_side;
+            long index = first + i;
+            for (int k = 0; k < DIM; k++) {
+                COORD(p[i], k) = (index % gen->grid_side) * spacing;
+                index /= gen->grid_side;
+            }
+            break;
+        }
+        case DUPLICATE:
+            p[i] = fixed_point(gen->seed, next_random(&state) % gen->pool_size);
+            break;
+        }
+    }
+}
 
-    n = strtol(argv[2], NULL, 10);
-    p = malloc(n * sizeof(struct Point));
+/* Generate and write every num_threads-th chunk, starting with chunk id.
+ * Chunks are written at their final offset with pwrite, so the threads do
+ * not have to coordinate.
+ */
+static void *generate_chunks(void *arg) {
+    struct worker *w = arg;
+    struct generator *gen = w->gen;
+
+    struct Point *p = malloc(CHUNK_POINTS * sizeof(struct Point));
     if (p == NULL) {
         perror("malloc");
         exit(1);
     }
 
-    printf("Generating %d random points with x- and y-coordinate range between %d and %d...\n", n, 0, RAND_MAX);
-    for (int i = 0; i < n; i++) {
-        p[i].x = rand();
-        p[i].y = rand();
-        // printf("P[%d] = (%d, %d)\n", i, p[i].x, p[i].y);
+    for (long first = (long) w->id * CHUNK_POINTS; first < gen->n;
+         first += (long) gen->num_threads * CHUNK_POINTS) {
+        int count = gen->n - first < CHUNK_POINTS ? gen->n - first : CHUNK_POINTS;
+        fill_chunk(gen, p, first, count);
+
+        size_t bytes = count * sizeof(struct Point);
+        off_t offset = gen->header_size + first * sizeof(struct Point);
+        char *buf = (char *) p;
+        while (bytes > 0) {
+            ssize_t written = pwrite(gen->fd, buf, bytes, offset);
+            if (written == -1) {
+                perror("pwrite");
+                exit(1);
+            }
+            buf += written;
+            bytes -= written;
+            offset += written;
+        }
     }
 
-    f = fopen(argv[1], "wb");
-    if (f == NULL) {
-        perror(argv[1]);
-        exit(1);
+    free(p);
+    return NULL;
+}
+
+void print_usage(char *prog) {
+    fprintf(stderr, "Usage: %s [-D distribution] [-s seed] [-j threads] [-V] "
+            "filename total_points\n\n", prog);
+    fprintf(stderr, "    -D uniform (default), cluster, gaussian, grid or dup\n");
+    fprintf(stderr, "    -s Seed for the random streams (default 1)\n");
+    fprintf(stderr, "    -j Number of generator threads (default: all cores)\n");
+    fprintf(stderr, "    -V Write the versioned header even for 2D int points\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    struct generator gen;
+    int opt;
+    int versioned = 0;
+
+    gen.dist = UNIFORM;
+    gen.seed = 1;
+    gen.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((opt = getopt(argc, argv, "D:s:j:V")) != -1) {
+        switch (opt) {
+        case 'D': {
+            int d;
+            for (d = 0; d <= DUPLICATE; d++) {
+                if (strcmp(optarg, dist_names[d]) == 0) {
+                    break;
+                }
+            }
+            if (d > DUPLICATE) {
+                print_usage(argv[0]);
+            }
+            gen.dist = d;
+            break;
+        }
+        case 's':
+            gen.seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            gen.num_threads = strtol(optarg, NULL, 10);
+            break;
+        case 'V':
+            versioned = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+        }
     }
 
-    bytes_written = fwrite(&n, sizeof(n), 1, f);
-    if (bytes_written != 1) {
-        fprintf(stderr, "Error writing n to data file.\n");
-        exit(1);
+    if (argc - optind != 2 || gen.num_threads < 1) {
+        print_usage(argv[0]);
     }
-    bytes_written = fwrite(p, sizeof(struct Point), n, f);
-    if (bytes_written != n) {
-        fprintf(stderr, "Error writing Point structs to data file.\n");
+
+    gen.n = strtol(argv[optind + 1], NULL, 10);
+    if (gen.n < 0) {
+        print_usage(argv[0]);
+    }
+    // The smallest side whose DIM-th power holds all the points
+    gen.grid_side = 1;
+    while (pow(gen.grid_side, DIM) < gen.n) {
+        gen.grid_side++;
+    }
+    gen.pool_size = gen.n / 16 > 0 ? gen.n / 16 : 1;
+
+    printf("Generating %ld %s points with %s range between %d and " COORD_FMT
+           "...\n", gen.n, dist_names[gen.dist], COORD_NAMES, 0,
+           (coord_t) COORD_MAX);
+
+    gen.fd = open(argv[optind], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (gen.fd == -1) {
+        perror(argv[optind]);
         exit(1);
     }
 
-    if (fclose(f)) {
+    // The original format, an int count followed by the points, is kept
+    // for the 2D int points it can describe. Anything else gets the
+    // versioned header.
+    if (!versioned && DIM == 2 && COORD_TYPE == COORD_INT32 && gen.n <= INT_MAX) {
+        int n = gen.n;
+        gen.header_size = sizeof(n);
+        if (pwrite(gen.fd, &n, sizeof(n), 0) != sizeof(n)) {
+            fprintf(stderr, "Error writing n to data file.\n");
+            exit(1);
+        }
+    } else {
+        struct PointsHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, POINTS_MAGIC, sizeof(h.magic));
+        h.version = POINTS_VERSION;
+        h.type = COORD_TYPE;
+        h.dims = DIM;
+        h.count = gen.n;
+        gen.header_size = sizeof(h);
+        if (pwrite(gen.fd, &h, sizeof(h), 0) != sizeof(h)) {
+            fprintf(stderr, "Error writing the header to data file.\n");
+            exit(1);
+        }
+    }
+
+    pthread_t tids[gen.num_threads];
+    struct worker workers[gen.num_threads];
+    for (int i = 0; i < gen.num_threads; i++) {
+        workers[i].gen = &gen;
+        workers[i].id = i;
+        if ((errno = pthread_create(&tids[i], NULL, generate_chunks,
+                                    &workers[i])) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < gen.num_threads; i++) {
+        if ((errno = pthread_join(tids[i], NULL)) != 0) {
+            perror("pthread_join");
+            exit(1);
+        }
+    }
+
+    if (close(gen.fd)) {
         fprintf(stderr, "Error closing data file.\n");
         exit(1);
     }
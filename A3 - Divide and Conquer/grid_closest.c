@@ -0,0 +1,213 @@
+/*
+ * Randomized incremental closest pair of points using a hashed grid
+ * (Golin, Raman, Schwarz and Smid), in expected O(n) time.
+ *
+ * The points are visited in random order while keeping a grid of square
+ * cells whose side is twice the smallest distance d seen so far. A point
+ * closer than d to the current one must be in the 2x2 block of cells
+ * nearest to it.
+ * Whenever d shrinks, the grid is rebuilt from the points visited so far;
+ * in random order this happens O(log n) times in expectation and its
+ * expected total cost is linear.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "grid_closest.h"
+
+
+// One occupied cell of the grid: its coordinates and its chain of points.
+struct cell {
+    unsigned long key;  // Cell coordinates packed by cell_key()
+    int head;           // Index of the last point added to the cell
+    int gen;            // The slot is in use only if gen matches the grid's
+};
+
+struct grid {
+    struct cell *cells;
+    int *next;          // next[i] is the point after point i in its cell
+    int *id;            // id[i] is the position point i had before shuffling
+    int mask;           // Number of slots - 1 (a power of 2)
+    int gen;            // Bumped to empty the grid without touching the slots
+    double scale;       // 1 / side of a cell
+    coord_t ox, oy;     // Corner of the bounding box, where cell 0 starts
+    double extent;      // Width of the bounding box in x and y
+};
+
+/*
+ * Pack cell coordinates into one key. cell_side() keeps the cells wide
+ * enough that the coordinates fit in 32 bits each.
+ */
+static inline unsigned long cell_key(long cx, long cy) {
+    return (unsigned long) (unsigned int) cx << 32 | (unsigned int) cy;
+}
+
+// Return the slot of the cell with the given key, or the empty slot for it.
+static struct cell *find_cell(struct grid *g, unsigned long key) {
+    int slot = (key * 0x9e3779b97f4a7c15UL >> 32) & g->mask;
+
+    while (g->cells[slot].gen == g->gen && g->cells[slot].key != key) {
+        slot = (slot + 1) & g->mask;
+    }
+    return &g->cells[slot];
+}
+
+static void insert_point(struct grid *g, struct Point *p, int i) {
+    unsigned long key = cell_key(floor(COORD_DIFF(p[i].x, g->ox) * g->scale),
+                                 floor(COORD_DIFF(p[i].y, g->oy) * g->scale));
+    struct cell *c = find_cell(g, key);
+
+    if (c->gen != g->gen) {
+        c->key = key;
+        c->head = -1;
+        c->gen = g->gen;
+    }
+    g->next[i] = c->head;
+    c->head = i;
+}
+
+/*
+ * Empty the grid and refill it with p[0..count). The cells are at least
+ * twice as wide as d, so every point within d of a point lies in the 2x2
+ * block of cells nearest to it.
+ */
+static void rebuild(struct grid *g, struct Point *p, int count, double d) {
+    g->gen++;
+    g->scale = 1 / cell_side(d, g->extent);
+    for (int i = 0; i < count; i++) {
+        insert_point(g, p, i);
+    }
+}
+
+/*
+ * Return the pair of p[i] and the closest point in the grid if it is closer
+ * than best, or best otherwise.
+ */
+static struct Pair closest_in_grid(struct grid *g, struct Point *p, int i,
+                                   struct Pair best) {
+    double fx = COORD_DIFF(p[i].x, g->ox) * g->scale;
+    double fy = COORD_DIFF(p[i].y, g->oy) * g->scale;
+    long cx = floor(fx), cy = floor(fy);
+
+    // Pick the neighbouring column and row on the side the point is nearer.
+    long nx = fx - cx < 0.5 ? cx - 1 : cx + 1;
+    long ny = fy - cy < 0.5 ? cy - 1 : cy + 1;
+    long xs[2] = {cx, nx}, ys[2] = {cy, ny};
+
+    for (int a = 0; a < 2; a++) {
+        for (int b = 0; b < 2; b++) {
+            struct cell *c = find_cell(g, cell_key(xs[a], ys[b]));
+            if (c->gen != g->gen) {
+                continue;
+            }
+            for (int j = c->head; j != -1; j = g->next[j]) {
+                if (dist(p[i], p[j]) < best.d) {
+                    best.d = dist(p[i], p[j]);
+                    best.p1 = p[j];
+                    best.p2 = p[i];
+                    best.i1 = g->id[j];
+                    best.i2 = g->id[i];
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/*
+ * Find the closest pair of points in p[]. The array does not need to be
+ * sorted; it is shuffled in place. The pair holds the positions its points
+ * had in p[] before the shuffle.
+ */
+struct Pair closest_grid(struct Point *p, int n) {
+    if (n < 2) {
+        return brute_force(p, n);
+    }
+
+    struct grid g;
+    g.id = malloc(sizeof(int) * n);
+    if (g.id == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        g.id[i] = i;
+    }
+
+    // Fisher-Yates shuffle with a fixed-seed xorshift generator, so runs
+    // are repeatable.
+    unsigned long state = 0x853c49e6748fea9bUL;
+    for (int i = n - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int j = state % (i + 1);
+        struct Point tmp = p[i];
+        p[i] = p[j];
+        p[j] = tmp;
+        int tmp_id = g.id[i];
+        g.id[i] = g.id[j];
+        g.id[j] = tmp_id;
+    }
+
+    struct Pair best = brute_force(p, 2);
+    best.i1 = g.id[0];
+    best.i2 = g.id[1];
+    if (best.d == 0) {
+        free(g.id);
+        return best;
+    }
+
+    int slots = 1;
+    while (slots < 2 * n) {
+        slots *= 2;
+    }
+    g.cells = calloc(slots, sizeof(struct cell));
+    g.next = malloc(sizeof(int) * n);
+    if (g.cells == NULL || g.next == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    g.mask = slots - 1;
+    g.gen = 0;
+
+    coord_t max_x = p[0].x, max_y = p[0].y;
+    g.ox = p[0].x;
+    g.oy = p[0].y;
+    for (int i = 1; i < n; i++) {
+        if (p[i].x < g.ox) {
+            g.ox = p[i].x;
+        } else if (p[i].x > max_x) {
+            max_x = p[i].x;
+        }
+        if (p[i].y < g.oy) {
+            g.oy = p[i].y;
+        } else if (p[i].y > max_y) {
+            max_y = p[i].y;
+        }
+    }
+    g.extent = fmax(COORD_DIFF(max_x, g.ox), COORD_DIFF(max_y, g.oy));
+    rebuild(&g, p, 2, best.d);
+
+    for (int i = 2; i < n; i++) {
+        struct Pair found = closest_in_grid(&g, p, i, best);
+        if (found.d < best.d) {
+            best = found;
+            if (best.d == 0) {
+                break;  // Duplicate points; nothing can be closer
+            }
+            rebuild(&g, p, i + 1, best.d);
+        } else {
+            insert_point(&g, p, i);
+        }
+    }
+
+    free(g.cells);
+    free(g.next);
+    free(g.id);
+    return best;
+}
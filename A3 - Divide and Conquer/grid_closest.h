@@ -0,0 +1,6 @@
+#ifndef _GRID_CLOSEST_H
+#define _GRID_CLOSEST_H
+
+struct Pair closest_grid(struct Point *p, int n);
+
+#endif /* _GRID_CLOSEST_H */
@@ -0,0 +1,335 @@
+/*
+ * All nearest neighbours: for every point, the closest other point.
+ *
+ * The recursion splits the points by x like closest_serial(). Each half
+ * finds the nearest neighbours of its points among themselves and is left
+ * sorted by y, as in the soa engine. A point can then only have a closer
+ * neighbour on the other side if it is closer to the dividing line than
+ * to its current neighbour, and that neighbour lies in the strip of the
+ * other side within a y window around it, which is found by binary search.
+ *
+ * The top levels of the recursion are split among forked workers like
+ * closest_parallel_shm(). Each point carries its neighbour so far, and the
+ * points are mapped shared, so the workers sort and solve their halves in
+ * place.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "parallel_closest.h"
+#include "neighbours_closest.h"
+
+
+// A point, its position in the input and its nearest neighbour so far.
+struct nn_point {
+    struct Point p;
+    int id;
+    int nn;             // Position of the nearest neighbour, or -1
+    double nd;          // Distance to it, or DBL_MAX
+};
+
+static int compare_nn_x(const void *a, const void *b) {
+    return compare_x(&((struct nn_point *) a)->p, &((struct nn_point *) b)->p);
+}
+
+// Record q as the neighbour of p if it is closer than p's current one.
+static inline void offer(struct nn_point *p, struct nn_point *q, double d) {
+    if (d < p->nd) {
+        p->nd = d;
+        p->nn = q->id;
+    }
+}
+
+/*
+ * Check the points of side[] that are closer to the line x = mid_x than
+ * to their current neighbour against the points of other[], the half on
+ * the other side of the line. Both are sorted by y. idx[] is scratch
+ * space for n + other_n indices.
+ */
+static void cross_check(struct nn_point *side, int n, struct nn_point *other,
+                        int other_n, coord_t mid_x, int *idx) {
+    // The points that may have a closer neighbour across the line, and the
+    // widest gap to the line that can still hold one
+    int *candidates = idx, count = 0;
+    double reach = 0;
+    for (int i = 0; i < n; i++) {
+        if (COORD_GAP(side[i].p.x, mid_x) < side[i].nd) {
+            candidates[count++] = i;
+            reach = side[i].nd > reach ? side[i].nd : reach;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+
+    // The strip holds the positions in other[] of the points near the line,
+    // so that they can be offered closer neighbours too.
+    int *strip = idx + n, size = 0;
+    for (int i = 0; i < other_n; i++) {
+        if (COORD_GAP(other[i].p.x, mid_x) < reach) {
+            strip[size++] = i;
+        }
+    }
+
+    for (int c = 0; c < count; c++) {
+        struct nn_point *q = &side[candidates[c]];
+
+        // The first point of the strip at or above q.
+        int lo = 0, hi = size;
+        while (lo < hi) {
+            int m = lo + (hi - lo) / 2;
+            if (other[strip[m]].p.y < q->p.y) {
+                lo = m + 1;
+            } else {
+                hi = m;
+            }
+        }
+
+        // Walk up and then down until the y gap alone is too large. The
+        // window shrinks as closer neighbours are found.
+        for (int j = lo; j < size &&
+             COORD_DIFF(other[strip[j]].p.y, q->p.y) < q->nd; j++) {
+            struct nn_point *o = &other[strip[j]];
+            double d = dist(q->p, o->p);
+            offer(q, o, d);
+            offer(o, q, d);
+        }
+        for (int j = lo - 1; j >= 0 &&
+             COORD_DIFF(q->p.y, other[strip[j]].p.y) < q->nd; j--) {
+            struct nn_point *o = &other[strip[j]];
+            double d = dist(q->p, o->p);
+            offer(q, o, d);
+            offer(o, q, d);
+        }
+    }
+}
+
+// Merge the y-sorted halves a[0..mid) and a[mid..n) through tmp[].
+static void merge_y(struct nn_point *a, struct nn_point *tmp, int mid, int n) {
+    int i = 0, j = mid, k = 0;
+    while (i < mid && j < n) {
+        tmp[k++] = (a[j].p.y < a[i].p.y) ? a[j++] : a[i++];
+    }
+    while (i < mid) {
+        tmp[k++] = a[i++];
+    }
+    while (j < n) {
+        tmp[k++] = a[j++];
+    }
+    memcpy(a, tmp, sizeof(struct nn_point) * n);
+}
+
+/*
+ * Combine two halves that have been solved and sorted by y: a[0..mid) to
+ * the left of the line x = mid_x and a[mid..n) to its right. tmp[] and
+ * idx[] are scratch space for n points and n indices.
+ */
+static void combine(struct nn_point *a, struct nn_point *tmp, int *idx,
+                    int mid, int n, coord_t mid_x) {
+    cross_check(a, mid, a + mid, n - mid, mid_x, idx);
+    cross_check(a + mid, n - mid, a, mid, mid_x, idx);
+    merge_y(a, tmp, mid, n);
+}
+
+/*
+ * Find the nearest neighbours of the points of a[] among themselves, where
+ * a[] is sorted by x, and leave a[] sorted by y. tmp[] and idx[] are
+ * scratch space for n points and n indices.
+ */
+static void neighbours_serial(struct nn_point *a, struct nn_point *tmp,
+                              int *idx, int n) {
+    if (n <= get_serial_cutoff()) {
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                double d = dist(a[i].p, a[j].p);
+                offer(&a[i], &a[j], d);
+                offer(&a[j], &a[i], d);
+            }
+        }
+        // Insertion sort by y.
+        for (int i = 1; i < n; i++) {
+            struct nn_point cur = a[i];
+            int j = i - 1;
+            while (j >= 0 && a[j].p.y > cur.p.y) {
+                a[j + 1] = a[j];
+                j--;
+            }
+            a[j + 1] = cur;
+        }
+        return;
+    }
+
+    int mid = n / 2;
+    coord_t mid_x = a[mid].p.x;
+    neighbours_serial(a, tmp, idx, mid);
+    neighbours_serial(a + mid, tmp + mid, idx + mid, n - mid);
+    combine(a, tmp, idx, mid, n, mid_x);
+}
+
+// Allocate scratch space for n points and n indices.
+static void alloc_scratch(int n, struct nn_point **tmp, int **idx) {
+    *tmp = malloc(sizeof(struct nn_point) * n);
+    *idx = malloc(sizeof(int) * n);
+    if ((*tmp == NULL || *idx == NULL) && n > 0) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+/*
+ * Solve a[] like neighbours_serial(), forking two children for the halves
+ * until the maximum depth has been reached. The number of workers in the
+ * subtree is stored in workers[node], numbered like a binary heap.
+ */
+static void neighbours_node(struct nn_point *a, int n, int pdmax,
+                            int *workers, int node) {
+    struct nn_point *tmp;
+    int *idx;
+
+    if (n < get_fork_cutoff() || pdmax == 0) {
+        alloc_scratch(n, &tmp, &idx);
+        neighbours_serial(a, tmp, idx, n);
+        free(tmp);
+        free(idx);
+        workers[node] = 0;
+        return;
+    }
+
+    int mid = n / 2;
+    coord_t mid_x = a[mid].p.x;
+    int child_pids[2];
+
+    for (int i = 0; i < 2; i++) {
+        child_pids[i] = fork();
+        if (child_pids[i] == -1) {
+            perror("fork");
+            exit(1);
+        } else if (child_pids[i] == 0) {
+            if (i == 0) {
+                neighbours_node(a, mid, pdmax - 1, workers, 2 * node);
+            } else {
+                neighbours_node(a + mid, n - mid, pdmax - 1, workers,
+                                2 * node + 1);
+            }
+            exit(0);
+        }
+    }
+
+    int status;
+    for (int i = 0; i < 2; i++) {
+        if (waitpid(child_pids[i], &status, 0) == -1) {
+            perror("waitpid");
+            exit(1);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "A worker process failed\n");
+            exit(1);
+        }
+    }
+    workers[node] = 2 + workers[2 * node] + workers[2 * node + 1];
+
+    alloc_scratch(n, &tmp, &idx);
+    combine(a, tmp, idx, mid, n, mid_x);
+    free(tmp);
+    free(idx);
+}
+
+// Map size bytes shared between this process and its children.
+static void *map_shared(size_t size) {
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return mem;
+}
+
+static void unmap_shared(void *mem, size_t size) {
+    if (munmap(mem, size) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+}
+
+/*
+ * Find the nearest neighbour of each of the n points of p[], in any order,
+ * using up to pdmax levels of worker processes. nn[i] is set to the
+ * position in p[] of the point closest to p[i] and nd[i] to its distance;
+ * with fewer than two points they are -1 and DBL_MAX. The number of
+ * workers is added to *pcount.
+ */
+void all_nearest(struct Point *p, int n, int pdmax, int *pcount, int *nn,
+                 double *nd) {
+    // Past some depth the subarrays are too small to be split.
+    int depth = 0;
+    while (depth < pdmax && (n >> depth) >= get_fork_cutoff()) {
+        depth++;
+    }
+
+    size_t points_size = sizeof(struct nn_point) * n + 1;
+    size_t workers_size = sizeof(int) * ((size_t) 2 << depth);
+    struct nn_point *a = map_shared(points_size);
+    int *workers = map_shared(workers_size);
+
+    for (int i = 0; i < n; i++) {
+        a[i].p = p[i];
+        a[i].id = i;
+        a[i].nn = -1;
+        a[i].nd = DBL_MAX;
+    }
+    qsort(a, n, sizeof(struct nn_point), compare_nn_x);
+
+    neighbours_node(a, n, depth, workers, 1);
+    *pcount += workers[1];
+
+    for (int i = 0; i < n; i++) {
+        nn[a[i].id] = a[i].nn;
+        nd[a[i].id] = a[i].nd;
+    }
+    unmap_shared(a, points_size);
+    unmap_shared(workers, workers_size);
+}
+
+/*
+ * Write the nearest neighbours of the n points of the file f_name to the
+ * file f_name.nn, in the same layout as the original points format: the
+ * number of points as an int, then the position of the nearest neighbour
+ * of each point as an int.
+ */
+void write_neighbours(char *f_name, int *nn, int n) {
+    char *nn_name = malloc(strlen(f_name) + strlen(".nn") + 1);
+    if (nn_name == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    strcpy(nn_name, f_name);
+    strcat(nn_name, ".nn");
+
+    FILE *fp = fopen(nn_name, "wb");
+    if (fp == NULL) {
+        perror(nn_name);
+        exit(1);
+    }
+    if (fwrite(&n, sizeof(int), 1, fp) != 1 ||
+        fwrite(nn, sizeof(int), n, fp) != (size_t) n) {
+        fprintf(stderr, "Error writing %s.\n", nn_name);
+        exit(1);
+    }
+    if (fclose(fp)) {
+        fprintf(stderr, "Error closing %s.\n", nn_name);
+        exit(1);
+    }
+    free(nn_name);
+}
@@ -0,0 +1,8 @@
+#ifndef _NEIGHBOURS_CLOSEST_H
+#define _NEIGHBOURS_CLOSEST_H
+
+void all_nearest(struct Point *p, int n, int pdmax, int *pcount, int *nn,
+                 double *nd);
+void write_neighbours(char *f_name, int *nn, int n);
+
+#endif /* _NEIGHBOURS_CLOSEST_H */
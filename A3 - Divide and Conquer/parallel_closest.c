@@ -1,25 +1,47 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 
 #include "point.h"
 #include "serial_closest.h"
 #include "parallel_closest.h"
 #include "utilities_closest.h"
+#include "trace_closest.h"
 
 
+// Subarrays with fewer points than this are not worth forking for.
+static int fork_cutoff = 4;
+
+/*
+ * Set the smallest subarray for which the parallel engines still fork
+ * workers; smaller ones are solved serially whatever the depth. It is never
+ * less than 4.
+ */
+void set_fork_cutoff(int n) {
+    fork_cutoff = n < 4 ? 4 : n;
+}
+
+// Return the smallest subarray that the process tree is split for.
+int get_fork_cutoff() {
+    return fork_cutoff;
+}
+
 /*
  * Multi-process (parallel) implementation of the recursive divide-and-conquer
- * algorithm to find the minimal distance between any two pair of points in p[].
+ * algorithm to find the closest pair of points in p[].
  * Assumes that the array p[] is sorted according to x coordinate.
+ * Like closest_serial(), the pair holds the positions of its points in p[].
  */
-double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
-    if (n < 4 || pdmax == 0) { // i.e. maximum depth has been reached
+struct Pair closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
+    if (n < fork_cutoff || pdmax == 0) { // i.e. maximum depth has been reached
         return closest_serial(p, n);
     }
+    double start = TRACE_NOW();
 
     // 2: Split Array
     int midpoint = n / 2;
@@ -29,6 +51,7 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
     int rightHalf = n - midpoint;
 
     // 3: Children
+    double forking = TRACE_NOW();
     int leftPipe[2];
     if (pipe(leftPipe) == -1) {
         perror("pipe");
@@ -47,13 +70,16 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
             exit(1);
         } 
 
-        // Send the distance to parent
-        double closest_left = closest_parallel(left, leftHalf, pdmax - 1, pcount);
+        // Send the pair to parent
+        TRACE_DOWN();
+        struct Pair closest_left = closest_parallel(left, leftHalf, pdmax - 1, pcount);
 
-        if (write(leftPipe[1], &closest_left, sizeof(double)) != sizeof(double)) {
+        double writing = TRACE_NOW();
+        if (write(leftPipe[1], &closest_left, sizeof(struct Pair)) != sizeof(struct Pair)) {
             perror("write from left child to pipe");
             exit(1);
         }
+        TRACE_SPAN(TRACE_PIPE_WRITE, writing, leftHalf, 0);
 
         if (close(leftPipe[1]) == -1) {
             perror("close lefts' pipe after writing");
@@ -87,13 +113,16 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
             exit(1);
         } 
 
-        // Send the distance to parent
-        double closest_right = closest_parallel(right, rightHalf, pdmax - 1, pcount);
+        // Send the pair to parent
+        TRACE_DOWN();
+        struct Pair closest_right = closest_parallel(right, rightHalf, pdmax - 1, pcount);
 
-        if (write(rightPipe[1], &closest_right, sizeof(double)) != sizeof(double)) {
+        double writing = TRACE_NOW();
+        if (write(rightPipe[1], &closest_right, sizeof(struct Pair)) != sizeof(struct Pair)) {
             perror("write from right child to pipe");
             exit(1);
         }
+        TRACE_SPAN(TRACE_PIPE_WRITE, writing, rightHalf, 0);
 
         if (close(rightPipe[1]) == -1) {
             perror("close right's pipe after writing");
@@ -109,7 +138,10 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
         }
     }
 
+    TRACE_SPAN(TRACE_FORK, forking, n, 0);
+
     // 4: Wait for both children 
+    double waiting = TRACE_NOW();
     int status;
     for (int i = 0; i < 2; i++) {
         if (wait(&status) == -1) {
@@ -122,10 +154,13 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
         }
     }
 
+    TRACE_SPAN(TRACE_WAIT, waiting, n, 0);
+
     // 5: Read results 
-    double left_distance, right_distance;
+    double reading = TRACE_NOW();
+    struct Pair left_pair, right_pair;
 
-    if (read(leftPipe[0], &left_distance, sizeof(double)) != sizeof(double)) {
+    if (read(leftPipe[0], &left_pair, sizeof(struct Pair)) != sizeof(struct Pair)) {
         perror("read from left pipe");
         exit(1);
     }
@@ -134,7 +169,7 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
         exit(1);
     }
 
-    if (read(rightPipe[0], &right_distance, sizeof(double)) != sizeof(double)) {
+    if (read(rightPipe[0], &right_pair, sizeof(struct Pair)) != sizeof(struct Pair)) {
         perror("read from right pipe");
         exit(1);
     }
@@ -143,29 +178,138 @@ double closest_parallel(struct Point *p, int n, int pdmax, int *pcount) {
         exit(1);
     }
 
+    TRACE_SPAN(TRACE_PIPE_READ, reading, n, 0);
+    right_pair = shift_pair(right_pair, midpoint);
+
     // 6: step 4 from the single-process recursive divide-and-conquer solution
     
-    double d = min(left_distance, right_distance);
+    double built = TRACE_NOW();
+    struct Pair best = min_pair(left_pair, right_pair);
+    double d = best.d;
 
-    struct Point *strip = malloc(sizeof(struct Point) * n);
-    if (!strip) {
-        perror("malloc");
-        exit(1);
-    }
     // Make strip with points near the line passing through the middle point
-    int strip_count = 0;
-    for (int i = 0; i < n; i++) {
-        if (abs(p[i].x - p[midpoint].x) < d) {
-            strip[strip_count++] = p[i];
+    int strip_count, strip_left, *ids;
+    struct Point *strip = build_strip(p, n, midpoint, d, &strip_count,
+                                      &strip_left, &ids);
+
+    TRACE_SPAN(TRACE_STRIP_BUILD, built, n, strip_count);
+
+    // 7: Find the closest points in strip (strip_closest sorts it by y)
+    double scanned = TRACE_NOW();
+    long comparisons;
+    best = strip_closest_count(strip, ids, strip_count, strip_left, best,
+                               &comparisons);
+    TRACE_SPAN(TRACE_STRIP_SCAN, scanned, strip_count, comparisons);
+    free(strip);
+    free(ids);
+
+    TRACE_SPAN(TRACE_SOLVE, start, n, 0);
+    return best;
+}
+
+
+
+/*
+ * One entry of the results table shared by all the processes of
+ * closest_parallel_shm(). Entries are numbered like a binary heap: the root
+ * is 1 and the children of node i are 2i and 2i + 1.
+ */
+struct node_result {
+    struct Pair pair;   // Closest pair of the node's points
+    int workers;        // Worker processes in the node's subtree
+};
+
+/*
+ * Find the closest pair of p[] and store it in table[node], forking two
+ * children that store their results in table[2 * node] and
+ * table[2 * node + 1] until the maximum depth has been reached.
+ */
+static void shm_node(struct Point *p, int n, int pdmax,
+                     struct node_result *table, int node) {
+    if (n < fork_cutoff || pdmax == 0) { // i.e. maximum depth has been reached
+        table[node].pair = closest_serial(p, n);
+        table[node].workers = 0;
+        return;
+    }
+
+    int midpoint = n / 2;
+    int child_pids[2];
+
+    for (int i = 0; i < 2; i++) {
+        child_pids[i] = fork();
+        if (child_pids[i] == -1) {
+            perror("fork");
+            exit(1);
+        } else if (child_pids[i] == 0) {
+            if (i == 0) {
+                shm_node(p, midpoint, pdmax - 1, table, 2 * node);
+            } else {
+                shm_node(p + midpoint, n - midpoint, pdmax - 1, table,
+                         2 * node + 1);
+            }
+            exit(0);
         }
     }
 
-    // Sort strip by y
-    qsort(strip, strip_count, sizeof(struct Point), compare_y);
+    // The children's results are in the table once they have exited.
+    int status;
+    for (int i = 0; i < 2; i++) {
+        if (waitpid(child_pids[i], &status, 0) == -1) {
+            perror("waitpid");
+            exit(1);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "A worker process failed\n");
+            exit(1);
+        }
+    }
+
+    struct Pair best = min_pair(table[2 * node].pair,
+                                shift_pair(table[2 * node + 1].pair, midpoint));
+    double d = best.d;
+    table[node].workers = 2 + table[2 * node].workers +
+                          table[2 * node + 1].workers;
+
+    // Make strip with points near the line passing through the middle point
+    int strip_count, strip_left, *ids;
+    struct Point *strip = build_strip(p, n, midpoint, d, &strip_count,
+                                      &strip_left, &ids);
 
-    // 7: Find the closest points in strip
-    double strip_distance = strip_closest(strip, strip_count, d);
+    table[node].pair = strip_closest(strip, ids, strip_count, strip_left,
+                                     best);
     free(strip);
-    return min(d, strip_distance);
+    free(ids);
 }
 
+/*
+ * Same algorithm as closest_parallel(), but the processes return their
+ * results through one results table mapped shared before the first fork
+ * instead of through a pipe per child, and worker counts are stored in the
+ * table instead of in exit statuses, so any depth is counted correctly.
+ * Assumes that the array p[] is sorted according to x coordinate.
+ */
+struct Pair closest_parallel_shm(struct Point *p, int n, int pdmax, int *pcount) {
+    // Past some depth the subarrays are too small to be split.
+    int depth = 0;
+    while (depth < pdmax && (n >> depth) >= fork_cutoff) {
+        depth++;
+    }
+
+    size_t size = sizeof(struct node_result) * ((size_t) 2 << depth);
+    struct node_result *table = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    shm_node(p, n, depth, table, 1);
+    struct Pair best = table[1].pair;
+    *pcount += table[1].workers;
+
+    if (munmap(table, size) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+    return best;
+}
@@ -1,6 +1,9 @@
 #ifndef _PARALLEL_CLOSEST_H
 #define _PARALLEL_CLOSEST_H
 
-double closest_parallel(struct Point *P, int n, int pdmax, int *pcount);
+struct Pair closest_parallel(struct Point *P, int n, int pdmax, int *pcount);
+struct Pair closest_parallel_shm(struct Point *P, int n, int pdmax, int *pcount);
+void set_fork_cutoff(int n);
+int get_fork_cutoff();
 
 #endif /* _PARALLEL_CLOSEST_H */
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "point.h"
+#include "parallel_sort.h"
+#include "utilities_closest.h"
+#include "trace_closest.h"
+
+
+/*
+ * Arguments for one sorting worker. The workers are threads rather than
+ * processes because they sort the caller's array in place.
+ */
+struct sort_job {
+    struct Point *p;
+    int *ids;
+    int n;
+    int pdmax;
+    int threads;    // Set by the worker: threads it started itself
+    int level;      // Recursion level of the worker, for tracing
+};
+
+static void *sort_worker(void *arg) {
+    struct sort_job *job = arg;
+
+    trace_level = job->level;
+
+    job->threads = sort_parallel(job->p, job->ids, job->n, job->pdmax);
+    return NULL;
+}
+
+/*
+ * Merge the runs p[0..mid) and p[mid..n), both sorted by x, back into p
+ * using tmp as scratch space for the left run. Unless ids is NULL, ids[] is
+ * merged the same way through tmp_ids.
+ */
+static void merge(struct Point *p, int *ids, int mid, int n, struct Point *tmp,
+                  int *tmp_ids) {
+    int i = 0, j = mid, k = 0;
+
+    memcpy(tmp, p, sizeof(struct Point) * mid);
+
+    if (ids == NULL) {
+        while (i < mid && j < n) {
+            if (p[j].x < tmp[i].x) {
+                p[k++] = p[j++];
+            } else {
+                p[k++] = tmp[i++];
+            }
+        }
+        while (i < mid) {
+            p[k++] = tmp[i++];
+        }
+        return;
+    }
+
+    memcpy(tmp_ids, ids, sizeof(int) * mid);
+    while (i < mid && j < n) {
+        if (p[j].x < tmp[i].x) {
+            ids[k] = ids[j];
+            p[k++] = p[j++];
+        } else {
+            ids[k] = tmp_ids[i];
+            p[k++] = tmp[i++];
+        }
+    }
+    while (i < mid) {
+        ids[k] = tmp_ids[i];
+        p[k++] = tmp[i++];
+    }
+}
+
+/*
+ * Multi-threaded sort of p[] by x coordinate using the same tree shape as
+ * closest_parallel(): each level splits the array in half and hands the
+ * left half to a new worker, so there are 2^pdmax leaf sorts running at
+ * once. The leaves are radix sorted and the halves are merged on the way
+ * back up. The sort is stable, and unless ids is NULL, ids[] is permuted
+ * along with p[]. Return the number of worker threads that were started.
+ */
+int sort_parallel(struct Point *p, int *ids, int n, int pdmax) {
+    double start = TRACE_NOW();
+    if (n < 2 || pdmax == 0) {
+        sort_x_ids(p, ids, n);
+        TRACE_SPAN(TRACE_SORT, start, n, 0);
+        return 0;
+    }
+
+    int mid = n / 2;
+    struct sort_job left = {p, ids, mid, pdmax - 1, 0, trace_level + 1};
+    pthread_t tid;
+
+    if ((errno = pthread_create(&tid, NULL, sort_worker, &left)) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    TRACE_DOWN();
+    int threads = 1 + sort_parallel(p + mid, ids != NULL ? ids + mid : NULL,
+                                    n - mid, pdmax - 1);
+    TRACE_UP();
+
+    if ((errno = pthread_join(tid, NULL)) != 0) {
+        perror("pthread_join");
+        exit(1);
+    }
+
+    struct Point *tmp = malloc(sizeof(struct Point) * mid);
+    int *tmp_ids = ids != NULL ? malloc(sizeof(int) * mid) : NULL;
+    if (tmp == NULL || (ids != NULL && tmp_ids == NULL)) {
+        perror("malloc");
+        exit(1);
+    }
+    double merging = TRACE_NOW();
+    merge(p, ids, mid, n, tmp, tmp_ids);
+    TRACE_SPAN(TRACE_MERGE, merging, n, 0);
+    free(tmp);
+    free(tmp_ids);
+
+    return threads + left.threads;
+}
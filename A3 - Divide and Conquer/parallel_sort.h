@@ -0,0 +1,6 @@
+#ifndef _PARALLEL_SORT_H
+#define _PARALLEL_SORT_H
+
+int sort_parallel(struct Point *p, int *ids, int n, int pdmax);
+
+#endif /* _PARALLEL_SORT_H */
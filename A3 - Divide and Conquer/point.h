@@ -1,10 +1,139 @@
 #ifndef _POINT_H
 #define _POINT_H
 
-// A structure to represent a Point in 2D plane
+// Number of coordinates of a point: build with -DDIM=3 or -DDIM=4 for 3D
+// or 4D points. The input files of each build only hold points of its DIM.
+#ifndef DIM
+#define DIM 2
+#endif
+
+#if DIM < 2 || DIM > 4
+#error "DIM must be 2, 3 or 4"
+#endif
+
+// Types of coordinates, as recorded in the header of an input file
+#define COORD_INT32 1
+#define COORD_INT64 2
+#define COORD_FLOAT 3
+#define COORD_DOUBLE 4
+
+// Type of the coordinates: int unless built with -DCOORD_TYPE=COORD_INT64,
+// COORD_FLOAT or COORD_DOUBLE.
+#ifndef COORD_TYPE
+#define COORD_TYPE COORD_INT32
+#endif
+
+/*
+ * For each type:
+ *   coord_t          the type of a coordinate
+ *   coord_key_t      an unsigned type for radix sorting coordinates
+ *   coord_diff_t     a type that holds the difference of two coordinates
+ *                    (and, for integers, its square) exactly or nearly so
+ *   COORD_DIFF(a, b) a - b as a coord_diff_t
+ *   COORD_GAP(a, b)  |a - b|, for comparing with distances
+ *   COORD_FMT        the printf() format of a coordinate
+ *   COORD_MAX        the largest coordinate that generate_points produces
+ */
+#if COORD_TYPE == COORD_INT32
+typedef int coord_t;
+typedef unsigned int coord_key_t;
+typedef long coord_diff_t;
+#define COORD_DIFF(a, b) ((long) (a) - (long) (b))
+#define COORD_GAP(a, b) labs(COORD_DIFF(a, b))
+#define COORD_FMT "%d"
+#define COORD_MAX RAND_MAX
+#define COORD_NAME "int32"
+#elif COORD_TYPE == COORD_INT64
+typedef long coord_t;
+typedef unsigned long coord_key_t;
+typedef long double coord_diff_t;
+#define COORD_DIFF(a, b) ((long double) (a) - (long double) (b))
+#define COORD_GAP(a, b) fabsl(COORD_DIFF(a, b))
+#define COORD_FMT "%ld"
+#define COORD_MAX ((1L << 62) - 1)
+#define COORD_NAME "int64"
+#elif COORD_TYPE == COORD_FLOAT || COORD_TYPE == COORD_DOUBLE
+#if COORD_TYPE == COORD_FLOAT
+typedef float coord_t;
+typedef unsigned int coord_key_t;
+#define COORD_FMT "%.9g"
+#define COORD_NAME "float"
+#else
+typedef double coord_t;
+typedef unsigned long coord_key_t;
+#define COORD_FMT "%.17g"
+#define COORD_NAME "double"
+#endif
+typedef double coord_diff_t;
+#define COORD_DIFF(a, b) ((double) (a) - (double) (b))
+#define COORD_GAP(a, b) fabs(COORD_DIFF(a, b))
+#define COORD_MAX ((double) RAND_MAX)
+#else
+#error "COORD_TYPE must be COORD_INT32, COORD_INT64, COORD_FLOAT or COORD_DOUBLE"
+#endif
+
+// Sign bit of a coordinate key
+#define COORD_KEY_SIGN ((coord_key_t) 1 << (8 * sizeof(coord_key_t) - 1))
+
+/*
+ * COORD_KEY(c) is c as an unsigned value that orders the same way as c.
+ * Flipping the sign bit moves negative values below the others; the bits
+ * of negative floating point values also have to be flipped, because
+ * larger bits mean more negative values.
+ */
+#if COORD_TYPE == COORD_FLOAT || COORD_TYPE == COORD_DOUBLE
+static inline coord_key_t float_key(coord_t c) {
+	union { coord_t c; coord_key_t k; } u = {c};
+	return (u.k & COORD_KEY_SIGN) ? ~u.k : u.k | COORD_KEY_SIGN;
+}
+#define COORD_KEY(c) float_key(c)
+#else
+#define COORD_KEY(c) ((coord_key_t) (c) ^ COORD_KEY_SIGN)
+#endif
+
+// A structure to represent a Point in 2D plane (or in DIM dimensions)
 struct Point {
-	int x;
-	int y;
+	coord_t x;
+	coord_t y;
+#if DIM > 2
+	coord_t z;
+#endif
+#if DIM > 3
+	coord_t w;
+#endif
+};
+
+// Coordinate k of point p: x, y, then z and w
+#define COORD(p, k) (((coord_t *) &(p))[k])
+
+/*
+ * A pair of points and the distance between them. i1 and i2 are the
+ * positions of p1 and p2 in the array the pair was found in, or -1 where
+ * an engine does not track them.
+ */
+struct Pair {
+	struct Point p1;
+	struct Point p2;
+	double d;
+	int i1;
+	int i2;
+};
+
+/*
+ * Input files either start with the number of points as an int, followed
+ * by the points with int coordinates (the original format), or with a
+ * struct PointsHeader, which records the type and number of coordinates
+ * and a 64-bit count, followed by the points.
+ */
+#define POINTS_MAGIC "CPTS"
+#define POINTS_VERSION 1
+
+struct PointsHeader {
+	char magic[4];          // POINTS_MAGIC
+	unsigned int version;   // POINTS_VERSION
+	unsigned int type;      // COORD_INT32, COORD_INT64, COORD_FLOAT or COORD_DOUBLE
+	unsigned int dims;      // Coordinates per point
+	unsigned long count;    // Number of points
 };
 
 #endif /* _POINT_H */
@@ -7,53 +7,79 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "point.h"
 #include "utilities_closest.h"
+#include "serial_closest.h"
+#include "trace_closest.h"
 
 
+// Subarrays of at most this many points are solved by brute force.
+static int serial_cutoff = 3;
+
+/*
+ * Set the largest subarray that closest_serial() solves by brute force
+ * instead of splitting it. It is never less than 3.
+ */
+void set_serial_cutoff(int n) {
+    serial_cutoff = n < 3 ? 3 : n;
+}
+
+// Return the largest subarray that is solved by brute force.
+int get_serial_cutoff() {
+    return serial_cutoff;
+}
+
 /*
- * Recursive divide-and-conquer implementation to find the minimal distance
- * between any two pair of points in array p. Assumes that the array P[] is  
- * sorted according to x the coordinate.
+ * Recursive divide-and-conquer implementation to find the closest pair of
+ * points in array p. Assumes that the array P[] is sorted according to x the
+ * coordinate. The pair holds the positions of its points in p[].
  */
-double closest_serial(struct Point *p, int n) {
-    // If there are 2 or 3 points, then use brute force.
-    if (n <= 3)
-        return brute_force(p, n);
+struct Pair closest_serial(struct Point *p, int n) {
+    double start = TRACE_NOW();
+
+    // If there are only a few points, then use brute force.
+    if (n <= serial_cutoff) {
+        struct Pair best = brute_force(p, n);
+        TRACE_SPAN(TRACE_BRUTE, start, n, (long) n * (n - 1) / 2);
+        return best;
+    }
 
     // Find the middle point.
     int mid = n / 2;
-    struct Point mid_point = p[mid];
 
     /*
      * Consider the vertical line passing through the middle point;
      * calculate the smallest distance dl on left of middle point and
      * dr on right side.
      */
-    double dl = closest_serial(p, mid);
-    double dr = closest_serial(p + mid, n - mid);
+    TRACE_DOWN();
+    struct Pair pl = closest_serial(p, mid);
+    struct Pair pr = shift_pair(closest_serial(p + mid, n - mid), mid);
+    TRACE_UP();
 
     // Find the smaller of two distances 
-    double d = min(dl, dr);
+    struct Pair best = min_pair(pl, pr);
+    double d = best.d;
 
     // Build an array strip[] that contains points close (closer than d) to the line passing through the middle point.
-    struct Point *strip = malloc(sizeof(struct Point) * n);
-    if (strip == NULL) {
-        perror("malloc");
-        exit(1);
-    }
+    // They are a range of p[] around mid, which is found by binary search.
+    double built = TRACE_NOW();
+    int j, left, *ids;
+    struct Point *strip = build_strip(p, n, mid, d, &j, &left, &ids);
 
-    int j = 0;
-    for (int i = 0; i < n; i++) {
-        if (abs(p[i].x - mid_point.x) < d) {
-            strip[j] = p[i], j++;
-        }
-    }
+    TRACE_SPAN(TRACE_STRIP_BUILD, built, n, j);
 
-    // Find the closest points in strip.  Return the minimum of d and closest distance in strip[].
-    double new_min = min(d, strip_closest(strip, j, d));
+    // Find the closest points in strip.  Return the closer of best and the closest pair in strip[].
+    double scanned = TRACE_NOW();
+    long comparisons;
+    best = strip_closest_count(strip, ids, j, left, best, &comparisons);
+    TRACE_SPAN(TRACE_STRIP_SCAN, scanned, j, comparisons);
     free(strip);
+    free(ids);
+
+    TRACE_SPAN(TRACE_SOLVE, start, n, 0);
 
-    return new_min;
+    return best;
 }
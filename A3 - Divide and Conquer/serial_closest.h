@@ -1,6 +1,8 @@
 #ifndef _SERIAL_CLOSEST_H
 #define _SERIAL_CLOSEST_H
 
-double closest_serial(struct Point *P, int n);
+struct Pair closest_serial(struct Point *P, int n);
+void set_serial_cutoff(int n);
+int get_serial_cutoff();
 
 #endif /* _SERIAL_CLOSEST_H */
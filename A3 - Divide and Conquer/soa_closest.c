@@ -0,0 +1,361 @@
+/*
+ * The divide and conquer closest pair algorithm on points stored as one
+ * array per coordinate.
+ *
+ * Instead of sorting every strip by y, each call leaves its subarray sorted
+ * by y by merging the two sorted halves, so the strip is filtered out of
+ * the merged arrays already in y order. The strip scan then only reads the
+ * y array until it finds a candidate close enough to need the rest. Past
+ * 2D the two halves of the strip are searched with cross_closest() instead.
+ */
+
+#include <stdio.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "soa_closest.h"
+
+
+/*
+ * Copy point i of the coordinate arrays src[] to position at of dst[].
+ * Spelled out for 2D so that the default build copies without a loop.
+ */
+#if DIM == 2
+#define COPY_POINT(dst, at, src, i) do { \
+        (dst)[0][at] = (src)[0][i]; \
+        (dst)[1][at] = (src)[1][i]; \
+    } while (0)
+#else
+#define COPY_POINT(dst, at, src, i) do { \
+        for (int k_ = 0; k_ < DIM; k_++) { \
+            (dst)[k_][at] = (src)[k_][i]; \
+        } \
+    } while (0)
+#endif
+
+/*
+ * Copy the n points of p[] into the coordinate arrays of s. Release them
+ * with soa_free().
+ */
+void soa_init(struct PointsSoA *s, struct Point *p, int n) {
+    for (int k = 0; k < DIM; k++) {
+        s->coord[k] = malloc(sizeof(coord_t) * n);
+        if (s->coord[k] == NULL && n > 0) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+    s->id = malloc(sizeof(int) * n);
+    if (s->id == NULL && n > 0) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < DIM; k++) {
+            s->coord[k][i] = COORD(p[i], k);
+        }
+        s->id[i] = i;
+    }
+    s->n = n;
+}
+
+void soa_free(struct PointsSoA *s) {
+    for (int k = 0; k < DIM; k++) {
+        free(s->coord[k]);
+    }
+    free(s->id);
+}
+
+/*
+ * Stable sort of the n points in the coordinate arrays c[] and their
+ * positions id[] by coordinate by: the radix sort of sort_x(), through the
+ * same helpers, moving all the arrays together.
+ */
+static void radix_sort(coord_t **c, int *id, int by, int n) {
+    coord_t *keys = c[by];
+
+    if (n < RADIX_CUTOFF) {
+        for (int i = 1; i < n; i++) {
+            coord_t cur[DIM];
+            for (int k = 0; k < DIM; k++) {
+                cur[k] = c[k][i];
+            }
+            int cur_id = id[i];
+            int j = i - 1;
+            while (j >= 0 && keys[j] > cur[by]) {
+                for (int k = 0; k < DIM; k++) {
+                    c[k][j + 1] = c[k][j];
+                }
+                id[j + 1] = id[j];
+                j--;
+            }
+            for (int k = 0; k < DIM; k++) {
+                c[k][j + 1] = cur[k];
+            }
+            id[j + 1] = cur_id;
+        }
+        return;
+    }
+
+    size_t count[RADIX_PASSES][256] = {{0}};
+    radix_count(keys, sizeof(coord_t), n, count);
+
+    coord_t *tmp[DIM], *src[DIM], *dst[DIM];
+    for (int k = 0; k < DIM; k++) {
+        tmp[k] = malloc(sizeof(coord_t) * n);
+        if (tmp[k] == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        src[k] = c[k];
+        dst[k] = tmp[k];
+    }
+    int *tmp_id = malloc(sizeof(int) * n);
+    if (tmp_id == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    int *src_id = id, *dst_id = tmp_id;
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        size_t pos[256];
+        if (!radix_starts(count[pass], n,
+                          RADIX_DIGIT(COORD_KEY(src[by][0]), pass), pos)) {
+            continue;  // Every key has the same digit here
+        }
+
+        for (int i = 0; i < n; i++) {
+            size_t at = pos[RADIX_DIGIT(COORD_KEY(src[by][i]), pass)]++;
+            COPY_POINT(dst, at, src, i);
+            dst_id[at] = src_id[i];
+        }
+
+        for (int k = 0; k < DIM; k++) {
+            coord_t *swap = src[k];
+            src[k] = dst[k];
+            dst[k] = swap;
+        }
+        int *swap_id = src_id;
+        src_id = dst_id;
+        dst_id = swap_id;
+    }
+
+    for (int k = 0; k < DIM; k++) {
+        if (src[k] != c[k]) {
+            memcpy(c[k], src[k], sizeof(coord_t) * n);
+        }
+        free(tmp[k]);
+    }
+    if (src_id != id) {
+        memcpy(id, src_id, sizeof(int) * n);
+    }
+    free(tmp_id);
+}
+
+// Sort the points of s according to X coordinate.
+void soa_sort_x(struct PointsSoA *s) {
+    radix_sort(s->coord, s->id, 0, s->n);
+}
+
+// Return the pair made of points i and j, which are d apart.
+static struct Pair make_pair(coord_t **c, int *id, int i, int j, double d) {
+    struct Pair pair;
+    for (int k = 0; k < DIM; k++) {
+        COORD(pair.p1, k) = c[k][i];
+        COORD(pair.p2, k) = c[k][j];
+    }
+    pair.d = d;
+    pair.i1 = id[i];
+    pair.i2 = id[j];
+    return pair;
+}
+
+// The same as dist() on points i and j.
+static inline double soa_dist(coord_t **c, int i, int j) {
+#if DIM == 2 && COORD_TYPE == COORD_INT32
+    long dx = (long) c[0][i] - c[0][j], dy = (long) c[1][i] - c[1][j];
+    return sqrt(dx * dx + dy * dy);
+#elif COORD_TYPE == COORD_INT32
+    unsigned long sum = 0;
+    for (int k = 0; k < DIM; k++) {
+        long diff = (long) c[k][i] - c[k][j];
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+#else
+    coord_diff_t sum = 0;
+    for (int k = 0; k < DIM; k++) {
+        coord_diff_t diff = COORD_DIFF(c[k][i], c[k][j]);
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+#endif
+}
+
+#if DIM > 2
+/*
+ * Return the closer of best and the closest pair with one point in each of
+ * c[0..mid) and c[mid..n), which are both sorted by y. Only the points
+ * within best.d of the line x = mid_x are searched, with cross_closest(),
+ * since past 2D a window on y alone holds points far apart in the other
+ * coordinates.
+ */
+static struct Pair cross_halves(coord_t **c, int *id, int mid, int n,
+                                coord_t mid_x, struct Pair best) {
+    struct Point *strip = malloc(sizeof(struct Point) * n);
+    int *ids = malloc(sizeof(int) * n);
+    if (strip == NULL || ids == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    int size = 0, left = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == mid) {
+            left = size;
+        }
+        if (COORD_GAP(c[0][i], mid_x) < best.d) {
+            for (int k = 0; k < DIM; k++) {
+                COORD(strip[size], k) = c[k][i];
+            }
+            ids[size++] = id[i];
+        }
+    }
+
+    struct PairHeap h = {&best, 1, 1};
+    cross_closest(strip, ids, left, strip + left, ids + left, size - left,
+                  &h);
+    free(strip);
+    free(ids);
+    return best;
+}
+#endif
+
+/*
+ * Find the closest pair among the n points of the coordinate arrays c[]
+ * and positions id[], which are sorted by x, and leave them sorted by y.
+ * The arrays t[] and tid[] are scratch space for n points.
+ */
+static struct Pair closest_range(coord_t **c, int *id, coord_t **t, int *tid,
+                                 int n) {
+    struct Pair best;
+    best.d = DBL_MAX;
+    best.i1 = best.i2 = -1;
+
+    if (n <= get_serial_cutoff()) {
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                double d = soa_dist(c, i, j);
+                if (d < best.d) {
+                    best = make_pair(c, id, i, j, d);
+                }
+            }
+        }
+        radix_sort(c, id, 1, n);
+        return best;
+    }
+
+    int mid = n / 2;
+    coord_t mid_x = c[0][mid];
+
+    coord_t *cr[DIM], *tr[DIM];
+    for (int k = 0; k < DIM; k++) {
+        cr[k] = c[k] + mid;
+        tr[k] = t[k] + mid;
+    }
+    struct Pair pl = closest_range(c, id, t, tid, mid);
+    struct Pair pr = closest_range(cr, id + mid, tr, tid + mid, n - mid);
+    best = min_pair(pl, pr);
+#if DIM > 2
+    best = cross_halves(c, id, mid, n, mid_x, best);
+#endif
+
+    // Merge the two halves, now sorted by y, through the scratch arrays.
+    coord_t *y = c[1];
+    int i = 0, j = mid, m = 0;
+    while (i < mid && j < n) {
+        if (y[j] < y[i]) {
+            COPY_POINT(t, m, c, j);
+            tid[m] = id[j];
+            j++;
+        } else {
+            COPY_POINT(t, m, c, i);
+            tid[m] = id[i];
+            i++;
+        }
+        m++;
+    }
+    for (; i < mid; i++, m++) {
+        COPY_POINT(t, m, c, i);
+        tid[m] = id[i];
+    }
+    for (; j < n; j++, m++) {
+        COPY_POINT(t, m, c, j);
+        tid[m] = id[j];
+    }
+    for (int k = 0; k < DIM; k++) {
+        memcpy(c[k], t[k], sizeof(coord_t) * n);
+    }
+    memcpy(id, tid, sizeof(int) * n);
+
+#if DIM == 2
+    // The scratch arrays are free again; the strip comes out in y order.
+    double min = best.d;
+    int size = 0;
+    for (i = 0; i < n; i++) {
+        if (COORD_GAP(c[0][i], mid_x) < min) {
+            COPY_POINT(t, size, c, i);
+            tid[size] = id[i];
+            size++;
+        }
+    }
+
+    coord_t *ty = t[1];
+    for (i = 0; i < size; i++) {
+        for (j = i + 1; j < size && COORD_DIFF(ty[j], ty[i]) < min; j++) {
+            double d = soa_dist(t, i, j);
+            if (d < min) {
+                min = d;
+                best = make_pair(t, tid, i, j, d);
+            }
+        }
+    }
+#endif
+
+    return best;
+}
+
+/*
+ * Find the closest pair of the points in s, which must be sorted by x.
+ * The points are left sorted by y. The pair holds the positions of its
+ * points in the array s was copied from.
+ */
+struct Pair closest_soa(struct PointsSoA *s) {
+    coord_t *t[DIM];
+    for (int k = 0; k < DIM; k++) {
+        t[k] = malloc(sizeof(coord_t) * s->n);
+        if (t[k] == NULL && s->n > 0) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+    int *tid = malloc(sizeof(int) * s->n);
+    if (tid == NULL && s->n > 0) {
+        perror("malloc");
+        exit(1);
+    }
+
+    struct Pair best = closest_range(s->coord, s->id, t, tid, s->n);
+
+    for (int k = 0; k < DIM; k++) {
+        free(t[k]);
+    }
+    free(tid);
+    return best;
+}
@@ -0,0 +1,20 @@
+#ifndef _SOA_CLOSEST_H
+#define _SOA_CLOSEST_H
+
+/*
+ * Points kept as one array per coordinate rather than as an array of
+ * struct Point, so that a pass over one coordinate only reads that
+ * coordinate.
+ */
+struct PointsSoA {
+    coord_t *coord[DIM];    // coord[0] holds the x coordinates, coord[1] y, ...
+    int *id;                // Position of each point in the array copied
+    int n;
+};
+
+void soa_init(struct PointsSoA *s, struct Point *p, int n);
+void soa_free(struct PointsSoA *s);
+void soa_sort_x(struct PointsSoA *s);
+struct Pair closest_soa(struct PointsSoA *s);
+
+#endif /* _SOA_CLOSEST_H */
@@ -0,0 +1,229 @@
+/*
+ * Divide-and-conquer search for the k closest pairs of points.
+ *
+ * The recursion is the same as in closest_serial() and closest_parallel(),
+ * but instead of a single minimum it keeps a bounded max-heap of the k
+ * closest pairs seen so far. The distance of the farthest pair in a full
+ * heap plays the role of d: it bounds the width of the strip and the search
+ * across it. Only pairs with one point on each side of the dividing line
+ * are taken from the strip, so no pair is counted twice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "parallel_closest.h"
+#include "topk_closest.h"
+
+
+/*
+ * Push every pair of p[] to h. Here and below, base is the position of p[0]
+ * in the array the pairs report positions in.
+ */
+static void brute_force_k(struct Point *p, int n, int base,
+                          struct PairHeap *h) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            struct Pair pair = {p[i], p[j], dist(p[i], p[j]), base + i,
+                                base + j};
+            heap_push(h, pair);
+        }
+    }
+}
+
+/*
+ * Push to h the pairs that cross the line between p[0..mid) and p[mid..n)
+ * and are closer than the heap bound. p[] is sorted by x, so the candidates
+ * on each side are a contiguous run next to the line.
+ */
+static void strip_closest_k(struct Point *p, int n, int mid, int base,
+                            struct PairHeap *h) {
+    double d = heap_bound(h);
+    int lo = mid, hi = mid;
+
+    while (lo > 0 && COORD_DIFF(p[mid].x, p[lo - 1].x) < d) {
+        lo--;
+    }
+    while (hi < n && COORD_DIFF(p[hi].x, p[mid].x) < d) {
+        hi++;
+    }
+
+    struct Point *strip = malloc(sizeof(struct Point) * (hi - lo));
+    int *ids = malloc(sizeof(int) * (hi - lo));
+    if (strip == NULL || ids == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    struct Point *left = strip, *right = strip + (mid - lo);
+    int *left_ids = ids, *right_ids = ids + (mid - lo);
+    int left_count = mid - lo, right_count = hi - mid;
+
+    for (int i = lo; i < hi; i++) {
+        strip[i - lo] = p[i];
+        ids[i - lo] = base + i;
+    }
+    sort_y_ids(left, left_ids, left_count);
+    sort_y_ids(right, right_ids, right_count);
+    cross_closest(left, left_ids, left_count, right, right_ids, right_count, h);
+
+    free(strip);
+    free(ids);
+}
+
+// closest_serial_k() on a subarray p[] that starts at position base.
+static void serial_k(struct Point *p, int n, int base, struct PairHeap *h) {
+    if (n <= 3) {
+        brute_force_k(p, n, base, h);
+        return;
+    }
+
+    int mid = n / 2;
+    serial_k(p, mid, base, h);
+    serial_k(p + mid, n - mid, base + mid, h);
+    strip_closest_k(p, n, mid, base, h);
+}
+
+/*
+ * Push the k closest pairs of p[] to h. Assumes that the array p[] is sorted
+ * according to x coordinate. The pairs hold the positions of their points
+ * in p[].
+ */
+void closest_serial_k(struct Point *p, int n, struct PairHeap *h) {
+    serial_k(p, n, 0, h);
+}
+
+// Write all of buf to fd or exit.
+static void write_all(int fd, void *buf, size_t size) {
+    char *pos = buf;
+    while (size > 0) {
+        ssize_t written = write(fd, pos, size);
+        if (written == -1) {
+            perror("write to pipe");
+            exit(1);
+        }
+        pos += written;
+        size -= written;
+    }
+}
+
+// Read exactly size bytes from fd into buf or exit.
+static void read_all(int fd, void *buf, size_t size) {
+    char *pos = buf;
+    while (size > 0) {
+        ssize_t num_read = read(fd, pos, size);
+        if (num_read <= 0) {
+            perror("read from pipe");
+            exit(1);
+        }
+        pos += num_read;
+        size -= num_read;
+    }
+}
+
+/*
+ * Fork a child that finds the k closest pairs of p[] and sends them back
+ * through a pipe. Return the reading end of the pipe.
+ */
+static int fork_k(struct Point *p, int n, int pdmax, int *pcount, int k) {
+    int fd[2];
+    if (pipe(fd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+
+    int result = fork();
+    if (result == -1) {
+        perror("fork");
+        exit(1);
+    } else if (result == 0) {
+        if (close(fd[0]) == -1) {
+            perror("close reading end from inside child");
+            exit(1);
+        }
+
+        struct PairHeap h;
+        heap_init(&h, k);
+        closest_parallel_k(p, n, pdmax, pcount, &h);
+        write_all(fd[1], &h.size, sizeof(int));
+        write_all(fd[1], h.pairs, sizeof(struct Pair) * h.size);
+
+        if (close(fd[1]) == -1) {
+            perror("close pipe after writing");
+            exit(1);
+        }
+        (*pcount)++;
+        exit(*pcount); // Exit with status num worker processes
+    }
+
+    if (close(fd[1]) == -1) {
+        perror("close writing end of pipe in parent");
+        exit(1);
+    }
+    return fd[0];
+}
+
+/*
+ * Push to h the pairs sent by a child through fd, which searched the points
+ * from position offset on.
+ */
+static void read_pairs(int fd, int offset, struct PairHeap *h) {
+    int size;
+    read_all(fd, &size, sizeof(int));
+
+    struct Pair *pairs = malloc(sizeof(struct Pair) * size);
+    if (pairs == NULL && size > 0) {
+        perror("malloc");
+        exit(1);
+    }
+    read_all(fd, pairs, sizeof(struct Pair) * size);
+    for (int i = 0; i < size; i++) {
+        heap_push(h, shift_pair(pairs[i], offset));
+    }
+    free(pairs);
+
+    if (close(fd) == -1) {
+        perror("close reading end of pipe in parent");
+        exit(1);
+    }
+}
+
+/*
+ * Multi-process version of closest_serial_k(). Each child sends back the
+ * k closest pairs of its half; the parent merges them into h before
+ * searching the strip. The pairs are read before waiting for the children,
+ * since k pairs may not fit in a pipe.
+ */
+void closest_parallel_k(struct Point *p, int n, int pdmax, int *pcount,
+                        struct PairHeap *h) {
+    if (n < get_fork_cutoff() || pdmax == 0) { // i.e. maximum depth has been reached
+        closest_serial_k(p, n, h);
+        return;
+    }
+
+    int mid = n / 2;
+    int left_fd = fork_k(p, mid, pdmax - 1, pcount, h->k);
+    int right_fd = fork_k(p + mid, n - mid, pdmax - 1, pcount, h->k);
+
+    read_pairs(left_fd, 0, h);
+    read_pairs(right_fd, mid, h);
+
+    int status;
+    for (int i = 0; i < 2; i++) {
+        if (wait(&status) == -1) {
+            perror("wait");
+            exit(1);
+        }
+        if (WIFEXITED(status)) {
+            // Add worker process count from child exit status
+            *pcount += WEXITSTATUS(status);
+        }
+    }
+
+    strip_closest_k(p, n, mid, 0, h);
+}
@@ -0,0 +1,8 @@
+#ifndef _TOPK_CLOSEST_H
+#define _TOPK_CLOSEST_H
+
+void closest_serial_k(struct Point *p, int n, struct PairHeap *h);
+void closest_parallel_k(struct Point *p, int n, int pdmax, int *pcount,
+                        struct PairHeap *h);
+
+#endif /* _TOPK_CLOSEST_H */
@@ -0,0 +1,184 @@
+/*
+ * Per-level profiling of the closest pair recursion, written out as a
+ * Chrome trace (the JSON trace event format read by chrome://tracing and
+ * Perfetto) and summarised per level on stderr.
+ *
+ * Every span is added to the totals of its level and kind. The spans of the
+ * top levels are also kept individually for the trace; deeper ones are far
+ * too many and too short to be worth drawing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "trace_closest.h"
+
+
+// Spans kept for the trace; later ones are only added to the totals.
+#define TRACE_EVENTS (1 << 20)
+
+// Levels whose spans are kept for the trace.
+#define TRACE_EVENT_LEVELS 12
+
+// Levels with totals of their own; deeper ones are added to the last.
+#define TRACE_LEVELS 64
+
+struct trace_event {
+    double start, end;
+    int kind, level;
+    int pid, tid;
+    long n, count;
+};
+
+struct trace_totals {
+    long calls;
+    long ns;            // Time spent, summed over all processes
+    long points;
+    long count;
+};
+
+struct TraceBuffer {
+    double origin;      // Time at which tracing started
+    long used;          // Event slots taken, possibly more than TRACE_EVENTS
+    struct trace_totals totals[TRACE_LEVELS][TRACE_KINDS];
+    struct trace_event events[TRACE_EVENTS];
+};
+
+struct TraceBuffer *trace_buf = NULL;
+__thread int trace_level = 0;
+
+static char *kind_names[TRACE_KINDS] = {
+    "solve", "brute_force", "strip_build", "strip_scan", "fork", "wait",
+    "pipe_read", "pipe_write", "sort", "merge"
+};
+
+// The meaning of the count of a span of kind, or NULL if it has none.
+static char *count_name(int kind) {
+    if (kind == TRACE_STRIP_BUILD) {
+        return "strip";
+    } else if (kind == TRACE_BRUTE || kind == TRACE_STRIP_SCAN) {
+        return "comparisons";
+    }
+    return NULL;
+}
+
+/*
+ * Start recording spans. The buffer is mapped shared, so this must be
+ * called before the worker processes are forked.
+ */
+void trace_start() {
+    trace_buf = mmap(NULL, sizeof(struct TraceBuffer), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (trace_buf == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    trace_buf->origin = get_time();
+    trace_level = 0;
+}
+
+// Record a span; use TRACE_SPAN(), which does nothing when not tracing.
+void trace_span(int kind, double start, long n, long count) {
+    double end = get_time();
+    int level = trace_level < TRACE_LEVELS ? trace_level : TRACE_LEVELS - 1;
+    struct trace_totals *t = &trace_buf->totals[level][kind];
+
+    __atomic_fetch_add(&t->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&t->ns, (long) ((end - start) * 1e9), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&t->points, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&t->count, count, __ATOMIC_RELAXED);
+
+    if (trace_level >= TRACE_EVENT_LEVELS) {
+        return;
+    }
+    long slot = __atomic_fetch_add(&trace_buf->used, 1, __ATOMIC_RELAXED);
+    if (slot >= TRACE_EVENTS) {
+        return;
+    }
+
+    struct trace_event *e = &trace_buf->events[slot];
+    e->start = start;
+    e->end = end;
+    e->kind = kind;
+    e->level = trace_level;
+    e->pid = getpid();
+    e->tid = syscall(SYS_gettid);
+    e->n = n;
+    e->count = count;
+}
+
+// Write the kept spans to the file f_name in the Chrome trace format.
+static void write_trace(char *f_name, long count) {
+    FILE *fp = fopen(f_name, "w");
+    if (fp == NULL) {
+        perror(f_name);
+        exit(1);
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (long i = 0; i < count; i++) {
+        struct trace_event *e = &trace_buf->events[i];
+        char *name = count_name(e->kind);
+
+        fprintf(fp, "{\"name\": \"%s\", \"cat\": \"closest\", \"ph\": \"X\", "
+                "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"level\": %d, \"points\": %ld",
+                kind_names[e->kind], (e->start - trace_buf->origin) * 1e6,
+                (e->end - e->start) * 1e6, e->pid, e->tid, e->level, e->n);
+        if (name != NULL) {
+            fprintf(fp, ", \"%s\": %ld", name, e->count);
+        }
+        fprintf(fp, "}}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+
+    if (fclose(fp)) {
+        fprintf(stderr, "Error closing %s.\n", f_name);
+        exit(1);
+    }
+}
+
+/*
+ * Stop tracing, write the trace to the file f_name and print the totals of
+ * each level to stderr. Every process that recorded spans must have exited
+ * or been joined.
+ */
+void trace_finish(char *f_name) {
+    long used = trace_buf->used;
+    long kept = used < TRACE_EVENTS ? used : TRACE_EVENTS;
+    write_trace(f_name, kept);
+
+    fprintf(stderr, "trace: %ld spans written to %s", kept, f_name);
+    if (used > kept) {
+        fprintf(stderr, ", %ld more only counted", used - kept);
+    }
+    fprintf(stderr, "\n%5s %-11s %9s %12s %12s %12s\n", "level", "span",
+            "calls", "time (s)", "points", "count");
+    for (int level = 0; level < TRACE_LEVELS; level++) {
+        for (int kind = 0; kind < TRACE_KINDS; kind++) {
+            struct trace_totals *t = &trace_buf->totals[level][kind];
+            if (t->calls == 0) {
+                continue;
+            }
+            fprintf(stderr, "%5d %-11s %9ld %12.6f %12ld ", level,
+                    kind_names[kind], t->calls, t->ns / 1e9, t->points);
+            if (count_name(kind) != NULL) {
+                fprintf(stderr, "%12ld %s\n", t->count, count_name(kind));
+            } else {
+                fprintf(stderr, "%12s\n", "-");
+            }
+        }
+    }
+
+    if (munmap(trace_buf, sizeof(struct TraceBuffer)) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+    trace_buf = NULL;
+}
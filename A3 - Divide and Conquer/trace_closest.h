@@ -0,0 +1,56 @@
+#ifndef _TRACE_CLOSEST_H
+#define _TRACE_CLOSEST_H
+
+/*
+ * Profiling of the recursion. While tracing, the engines record a span for
+ * each phase of each call, with its recursion level, process and thread.
+ * Spans go to a buffer mapped shared before the first fork, so the worker
+ * processes record into the same buffer as the parent.
+ */
+
+// The phases that are recorded.
+enum trace_kind {
+    TRACE_SOLVE,        // A whole call of closest_serial() or closest_parallel()
+    TRACE_BRUTE,        // Brute force on a small subarray
+    TRACE_STRIP_BUILD,  // Copying the points near the dividing line
+    TRACE_STRIP_SCAN,   // strip_closest(), including its sort by y
+    TRACE_FORK,         // Forking the two children
+    TRACE_WAIT,         // Waiting for the children to exit
+    TRACE_PIPE_READ,    // Reading the children's results
+    TRACE_PIPE_WRITE,   // Sending a result to the parent
+    TRACE_SORT,         // Sorting a subarray by x
+    TRACE_MERGE,        // Merging two sorted subarrays by x
+    TRACE_KINDS
+};
+
+struct TraceBuffer;
+
+// The buffer being recorded into, or NULL when not tracing.
+extern struct TraceBuffer *trace_buf;
+
+// Recursion level of the calling thread.
+extern __thread int trace_level;
+
+// The time a span starts, or 0 when not tracing.
+#define TRACE_NOW() (trace_buf != NULL ? get_time() : 0)
+
+/*
+ * Record a span of kind from start until now over n points. count is the
+ * strip size for TRACE_STRIP_BUILD and the number of distances computed for
+ * TRACE_BRUTE and TRACE_STRIP_SCAN.
+ */
+#define TRACE_SPAN(kind, start, n, count) do { \
+        if (trace_buf != NULL) { \
+            trace_span((kind), (start), (n), (count)); \
+        } \
+    } while (0)
+
+// Enter and leave a level of the recursion.
+#define TRACE_DOWN() do { if (trace_buf != NULL) trace_level++; } while (0)
+#define TRACE_UP() do { if (trace_buf != NULL) trace_level--; } while (0)
+
+void trace_start();
+void trace_span(int kind, double start, long n, long count);
+void trace_finish(char *f_name);
+
+#endif /* _TRACE_CLOSEST_H */
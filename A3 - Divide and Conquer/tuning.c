@@ -0,0 +1,191 @@
+/*
+ * Host-specific thresholds for the closest pair engines.
+ *
+ * The thresholds are read from the file named by $CLOSEST_TUNE, or from
+ * ~/.closest_tune, as lines of the form "name value". closest -c measures
+ * them on the current host and writes that file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "point.h"
+#include "utilities_closest.h"
+#include "serial_closest.h"
+#include "parallel_closest.h"
+#include "tuning.h"
+
+
+#define MAXPATH 1024
+
+/*
+ * A subarray is worth forking for when solving it serially takes this many
+ * times longer than creating and reaping a worker process.
+ */
+#define FORK_PAYOFF 10
+
+// Number of times each calibration measurement is repeated
+#define REPEATS 3
+
+// Candidate brute force cutoffs tried by calibrate()
+static int serial_candidates[] = {3, 4, 6, 8, 12, 16, 24, 32, 48, 64};
+
+// Put the path of the tuning file in path.
+static void tuning_path(char *path) {
+    char *env = getenv("CLOSEST_TUNE");
+    char *home = getenv("HOME");
+
+    if (env != NULL) {
+        snprintf(path, MAXPATH, "%s", env);
+    } else {
+        snprintf(path, MAXPATH, "%s/.closest_tune", home ? home : ".");
+    }
+}
+
+/*
+ * Set t to the defaults, which match the original fixed thresholds, and
+ * override them with any values in the tuning file.
+ */
+void load_tuning(struct Tuning *t) {
+    char path[MAXPATH], name[64];
+    int value;
+
+    t->serial_cutoff = 3;
+    t->fork_cutoff = 4;
+
+    tuning_path(path);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return;  // Not calibrated yet
+    }
+
+    while (fscanf(fp, "%63s %d", name, &value) == 2) {
+        if (strcmp(name, "serial_cutoff") == 0) {
+            t->serial_cutoff = value;
+        } else if (strcmp(name, "fork_cutoff") == 0) {
+            t->fork_cutoff = value;
+        }
+    }
+    fclose(fp);
+}
+
+// Write t to the tuning file.
+void save_tuning(struct Tuning *t) {
+    char path[MAXPATH];
+
+    tuning_path(path);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(fp, "serial_cutoff %d\n", t->serial_cutoff);
+    fprintf(fp, "fork_cutoff %d\n", t->fork_cutoff);
+    if (fclose(fp)) {
+        fprintf(stderr, "Error closing %s.\n", path);
+        exit(1);
+    }
+}
+
+/*
+ * Make the engines use the thresholds in t. The fork cutoff is left out: it
+ * only limits a depth picked by auto_depth(), and is set along with it, so
+ * that an explicit depth is followed exactly.
+ */
+void apply_tuning(struct Tuning *t) {
+    set_serial_cutoff(t->serial_cutoff);
+}
+
+/*
+ * Return a process tree depth for n points: deep enough to give every core
+ * a leaf, but never so deep that the leaves drop below the fork cutoff.
+ */
+int auto_depth(struct Tuning *t, int n) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int depth = 0;
+
+    while ((1L << depth) < cores && (n >> (depth + 1)) >= t->fork_cutoff) {
+        depth++;
+    }
+    return depth;
+}
+
+// Return the best of REPEATS timings of closest_serial() on p[].
+static double time_serial(struct Point *p, int n) {
+    double best = DBL_MAX;
+
+    for (int i = 0; i < REPEATS; i++) {
+        double start = get_time();
+        closest_serial(p, n);
+        best = min(best, get_time() - start);
+    }
+    return best;
+}
+
+// Return the average time to fork a worker that exits at once and reap it.
+static double time_fork() {
+    int forks = 50;
+
+    // Otherwise every child would flush a copy of the pending output.
+    fflush(stdout);
+    double start = get_time();
+
+    for (int i = 0; i < forks; i++) {
+        int pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(1);
+        } else if (pid == 0) {
+            exit(0);
+        }
+        if (waitpid(pid, NULL, 0) == -1) {
+            perror("waitpid");
+            exit(1);
+        }
+    }
+    return (get_time() - start) / forks;
+}
+
+/*
+ * Measure the thresholds on the n points of p[], which must be sorted by
+ * x, store them in t and report them on stdout.
+ */
+void calibrate(struct Tuning *t, struct Point *p, int n) {
+    double best = DBL_MAX;
+    int num_candidates = sizeof(serial_candidates) / sizeof(serial_candidates[0]);
+
+    for (int i = 0; i < num_candidates; i++) {
+        set_serial_cutoff(serial_candidates[i]);
+        double elapsed = time_serial(p, n);
+        printf("serial_cutoff %d: %.6f s\n", serial_candidates[i], elapsed);
+        if (elapsed < best) {
+            best = elapsed;
+            t->serial_cutoff = serial_candidates[i];
+        }
+    }
+    set_serial_cutoff(t->serial_cutoff);
+
+    // Forking copies the page tables of the whole input, so it is timed
+    // with the input mapped.
+    double per_point = best / (n > 0 ? n : 1);
+    double fork_cost = time_fork();
+    // A serial run too fast for the clock makes the quotient infinite (or
+    // NaN), so it is clamped before it becomes an int.
+    double fork_cutoff = FORK_PAYOFF * fork_cost / per_point;
+    if (!(fork_cutoff >= 4)) {
+        fork_cutoff = 4;
+    } else if (fork_cutoff > INT_MAX) {
+        fork_cutoff = INT_MAX;
+    }
+    t->fork_cutoff = fork_cutoff;
+    printf("fork: %.6f s, serial: %.9f s per point\n", fork_cost, per_point);
+
+    printf("serial_cutoff %d\n", t->serial_cutoff);
+    printf("fork_cutoff %d\n", t->fork_cutoff);
+}
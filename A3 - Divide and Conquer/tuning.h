@@ -0,0 +1,16 @@
+#ifndef _TUNING_H
+#define _TUNING_H
+
+// Thresholds that can be calibrated for the host.
+struct Tuning {
+    int serial_cutoff;  // Largest subarray solved by brute force
+    int fork_cutoff;    // Smallest subarray worth forking workers for
+};
+
+void load_tuning(struct Tuning *t);
+void save_tuning(struct Tuning *t);
+void apply_tuning(struct Tuning *t);
+int auto_depth(struct Tuning *t, int n);
+void calibrate(struct Tuning *t, struct Point *p, int n);
+
+#endif /* _TUNING_H */
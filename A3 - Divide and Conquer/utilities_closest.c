@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <float.h>
+#include <limits.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "point.h"
@@ -19,14 +25,143 @@
 int compare_x(const void *a, const void *b) {
     struct Point *p1 = (struct Point *)a;
     struct Point *p2 = (struct Point *)b;
-    return p1->x - p2->x;
+    // Subtracting could overflow when the coordinates have opposite signs.
+    return (p1->x > p2->x) - (p1->x < p2->x);
 }
 
 // Needed to sort array of points according to Y coordinate.
 int compare_y(const void* a, const void* b) {
     struct Point *p1 = (struct Point *)a;
     struct Point *p2 = (struct Point *)b;
-    return p1->y - p2->y;
+    return (p1->y > p2->y) - (p1->y < p2->y);
+}
+
+void radix_count(const coord_t *keys, size_t stride, int n,
+                 size_t count[RADIX_PASSES][256]) {
+    const char *at = (const char *) keys;
+    for (int i = 0; i < n; i++, at += stride) {
+        coord_key_t key = COORD_KEY(*(const coord_t *) at);
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            count[pass][RADIX_DIGIT(key, pass)]++;
+        }
+    }
+}
+
+int radix_starts(size_t count[256], int n, unsigned int first,
+                 size_t pos[256]) {
+    if (count[first] == (size_t) n) {
+        return 0;
+    }
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+        pos[b] = sum;
+        sum += count[b];
+    }
+    return 1;
+}
+
+// Return the sort key of p, which orders the same way as coordinate k.
+static inline coord_key_t radix_key(const struct Point *p, int k) {
+    return COORD_KEY(COORD(*p, k));
+}
+
+/*
+ * Stable LSD radix sort of p[] on coordinate k, one byte per pass. The
+ * histograms for all the passes are built in a single scan, and passes in
+ * which every key has the same digit are skipped. Unless ids is NULL, ids[]
+ * is permuted along with p[].
+ */
+static void radix_sort(struct Point *p, int *ids, int n, int k) {
+    if (n < RADIX_CUTOFF) {
+        for (int i = 1; i < n; i++) {
+            struct Point cur = p[i];
+            int cur_id = ids != NULL ? ids[i] : 0;
+            coord_key_t key = radix_key(&cur, k);
+            int j = i - 1;
+            while (j >= 0 && radix_key(&p[j], k) > key) {
+                p[j + 1] = p[j];
+                if (ids != NULL) {
+                    ids[j + 1] = ids[j];
+                }
+                j--;
+            }
+            p[j + 1] = cur;
+            if (ids != NULL) {
+                ids[j + 1] = cur_id;
+            }
+        }
+        return;
+    }
+
+    size_t count[RADIX_PASSES][256] = {{0}};
+    radix_count(&COORD(p[0], k), sizeof(struct Point), n, count);
+
+    struct Point *tmp = malloc(sizeof(struct Point) * n);
+    int *tmp_ids = ids != NULL ? malloc(sizeof(int) * n) : NULL;
+    if (tmp == NULL || (ids != NULL && tmp_ids == NULL)) {
+        perror("malloc");
+        exit(1);
+    }
+
+    struct Point *src = p, *dst = tmp;
+    int *src_ids = ids, *dst_ids = tmp_ids;
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        size_t pos[256];
+        if (!radix_starts(count[pass], n,
+                          RADIX_DIGIT(radix_key(&src[0], k), pass), pos)) {
+            continue;  // Every key has the same digit here
+        }
+
+        if (ids == NULL) {
+            for (int i = 0; i < n; i++) {
+                coord_key_t key = radix_key(&src[i], k);
+                dst[pos[RADIX_DIGIT(key, pass)]++] = src[i];
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                coord_key_t key = radix_key(&src[i], k);
+                size_t at = pos[RADIX_DIGIT(key, pass)]++;
+                dst[at] = src[i];
+                dst_ids[at] = src_ids[i];
+            }
+            int *swap_ids = src_ids;
+            src_ids = dst_ids;
+            dst_ids = swap_ids;
+        }
+
+        struct Point *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != p) {
+        memcpy(p, src, sizeof(struct Point) * n);
+        if (ids != NULL) {
+            memcpy(ids, src_ids, sizeof(int) * n);
+        }
+    }
+    free(tmp);
+    free(tmp_ids);
+}
+
+// Sort array of points according to X coordinate.
+void sort_x(struct Point *p, int n) {
+    radix_sort(p, NULL, n, 0);
+}
+
+// Sort array of points according to Y coordinate.
+void sort_y(struct Point *p, int n) {
+    radix_sort(p, NULL, n, 1);
+}
+
+// The same as sort_x(), applying the same permutation to ids[].
+void sort_x_ids(struct Point *p, int *ids, int n) {
+    radix_sort(p, ids, n, 0);
+}
+
+// The same as sort_y(), applying the same permutation to ids[].
+void sort_y_ids(struct Point *p, int *ids, int n) {
+    radix_sort(p, ids, n, 1);
 }
 
 // A utility function to find the distance between two points.
@@ -38,26 +173,97 @@ double dist(struct Point p1, struct Point p2) {
      * RAND_MAX seems to generally be set to INT_MAX. So as long as LONG_MAX 
      * is greater than 2*INT_MAX^2 we are safe. -Furkan
      */
+#if DIM == 2 && COORD_TYPE == COORD_INT32
     return sqrt(((long) p1.x - (long) p2.x) * ((long) p1.x - (long) p2.x) +
                 ((long) p1.y - (long) p2.y) * ((long) p1.y - (long) p2.y));
+#elif COORD_TYPE == COORD_INT32
+    // Up to four squares still fit below ULONG_MAX, but not LONG_MAX.
+    unsigned long sum = 0;
+    for (int k = 0; k < DIM; k++) {
+        long diff = (long) COORD(p1, k) - (long) COORD(p2, k);
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+#else
+    // Wider coordinates are subtracted in floating point: a long double
+    // holds the difference of two longs exactly.
+    coord_diff_t sum = 0;
+    for (int k = 0; k < DIM; k++) {
+        coord_diff_t diff = COORD_DIFF(COORD(p1, k), COORD(p2, k));
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+#endif
+}
+
+// Return whether p1 and p2 have the same coordinates.
+int same_point(struct Point p1, struct Point p2) {
+    for (int k = 0; k < DIM; k++) {
+        if (COORD(p1, k) != COORD(p2, k)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Print the coordinates of p in parentheses, separated by commas.
+void print_point(FILE *fp, struct Point p) {
+    fprintf(fp, "(" COORD_FMT, p.x);
+    for (int k = 1; k < DIM; k++) {
+        fprintf(fp, ", " COORD_FMT, COORD(p, k));
+    }
+    fprintf(fp, ")");
 }
 
 /*
- * Brute Force method to find minimal distance between two points in an
- * array p of size n.
+ * Read the DIM coordinates of *p from the string s, separated by spaces.
+ * Return 1 on success and 0 if s does not start with DIM coordinates.
  */
-double brute_force(struct Point *p, int n) {
-    double min = DBL_MAX;
+int parse_point(char *s, struct Point *p) {
+    for (int k = 0; k < DIM; k++) {
+        char *end;
+        errno = 0;
+#if COORD_TYPE == COORD_INT32
+        long value = strtol(s, &end, 10);
+        if (value < INT_MIN || value > INT_MAX) {
+            return 0;
+        }
+#elif COORD_TYPE == COORD_INT64
+        long value = strtol(s, &end, 10);
+#else
+        double value = strtod(s, &end);
+#endif
+        if (end == s || errno == ERANGE) {
+            return 0;
+        }
+        COORD(*p, k) = value;
+        s = end;
+    }
+    return 1;
+}
+
+/*
+ * Brute Force method to find the closest pair of points in an array p of
+ * size n. If there are fewer than two points, the distance is DBL_MAX.
+ */
+struct Pair brute_force(struct Point *p, int n) {
+    struct Pair best;
+    best.d = DBL_MAX;
+    best.i1 = best.i2 = -1;
 
     for (int i = 0; i < n; ++i) {
         for (int j = i + 1; j < n; ++j) {
-            if (dist(p[i], p[j]) < min) {
-                min = dist(p[i], p[j]);
+            if (dist(p[i], p[j]) < best.d) {
+                best.d = dist(p[i], p[j]);
+                best.p1 = p[i];
+                best.p2 = p[j];
+                best.i1 = i;
+                best.i2 = j;
             }
         }
     }
 
-    return min;
+    return best;
 }
 
 // Return smallest of two double values 
@@ -65,17 +271,303 @@ double min(double x, double y) {
     return (x < y) ? x : y;
 }
 
+// Return the closer of two pairs
+struct Pair min_pair(struct Pair a, struct Pair b) {
+    return (a.d <= b.d) ? a : b;
+}
+
+/*
+ * Return pair with the positions of its points moved by offset, for a pair
+ * found in a subarray that starts at position offset.
+ */
+struct Pair shift_pair(struct Pair pair, int offset) {
+    if (pair.i1 != -1) {
+        pair.i1 += offset;
+        pair.i2 += offset;
+    }
+    return pair;
+}
+
+void heap_init(struct PairHeap *h, int k) {
+    h->pairs = malloc(sizeof(struct Pair) * k);
+    if (h->pairs == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    h->size = 0;
+    h->k = k;
+}
+
+void heap_free(struct PairHeap *h) {
+    free(h->pairs);
+}
+
+/*
+ * Return the distance a pair must beat to enter the heap: the farthest pair
+ * held once the heap is full, and DBL_MAX until then.
+ */
+double heap_bound(struct PairHeap *h) {
+    return h->size < h->k ? DBL_MAX : h->pairs[0].d;
+}
+
+// Restore the heap property below index i.
+static void sift_down(struct Pair *pairs, int size, int i) {
+    for (;;) {
+        int largest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < size && pairs[l].d > pairs[largest].d) {
+            largest = l;
+        }
+        if (r < size && pairs[r].d > pairs[largest].d) {
+            largest = r;
+        }
+        if (largest == i) {
+            return;
+        }
+        struct Pair tmp = pairs[i];
+        pairs[i] = pairs[largest];
+        pairs[largest] = tmp;
+        i = largest;
+    }
+}
+
+// Add pair to the heap if it is closer than the farthest pair held.
+void heap_push(struct PairHeap *h, struct Pair pair) {
+    if (h->size < h->k) {
+        int i = h->size++;
+        while (i > 0 && h->pairs[(i - 1) / 2].d < pair.d) {
+            h->pairs[i] = h->pairs[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        h->pairs[i] = pair;
+    } else if (pair.d < h->pairs[0].d) {
+        h->pairs[0] = pair;
+        sift_down(h->pairs, h->size, 0);
+    }
+}
+
+/*
+ * Sort the pairs in the heap from closest to farthest. The heap can no
+ * longer be pushed to afterwards.
+ */
+void heap_sort(struct PairHeap *h) {
+    for (int end = h->size - 1; end > 0; end--) {
+        struct Pair tmp = h->pairs[0];
+        h->pairs[0] = h->pairs[end];
+        h->pairs[end] = tmp;
+        sift_down(h->pairs, end, 0);
+    }
+}
+
+double cell_side(double d, double extent) {
+    double side = extent / CELLS_MAX;
+    if (d != DBL_MAX && 2 * d > side) {
+        side = 2 * d;
+    }
+    // A zero or denormal side would make 1 / side overflow.
+    if (!(side >= DBL_MIN)) {
+        side = extent >= DBL_MIN ? extent : 1;
+    }
+    return side;
+}
+
+/*
+ * Below this many pairs, the pairs across a split of cross_pairs() are all
+ * compared instead of being split further.
+ */
+#define CROSS_CUTOFF 64
+
+// Return ids + offset, or NULL if there are no ids.
+static inline int *ids_at(int *ids, int offset) {
+    return ids != NULL ? ids + offset : NULL;
+}
+
+// Push to h the pair of a[i] and b[j], which are d apart.
+static inline void push_cross(struct PairHeap *h, struct Point *a, int *aid,
+                              int i, struct Point *b, int *bid, int j,
+                              double d) {
+    struct Pair pair = {a[i], b[j], d, aid != NULL ? aid[i] : -1,
+                        bid != NULL ? bid[j] : -1};
+    heap_push(h, pair);
+}
+
+static long cross_pairs(struct Point *a, int *aid, int an, struct Point *b,
+                        int *bid, int bn, int k, struct PairHeap *h);
+
+/*
+ * Search the pairs of a point of a[a_lo..a_hi) and a point of
+ * b[b_lo..b_hi) on coordinate k, sorting copies of both by it.
+ */
+static long cross_copies(struct Point *a, int *aid, int a_lo, int a_hi,
+                         struct Point *b, int *bid, int b_lo, int b_hi, int k,
+                         struct PairHeap *h) {
+    int an = a_hi - a_lo, bn = b_hi - b_lo;
+    if (an == 0 || bn == 0) {
+        return 0;
+    }
+
+    struct Point *copy = malloc(sizeof(struct Point) * (an + bn));
+    int *copy_ids = aid != NULL ? malloc(sizeof(int) * (an + bn)) : NULL;
+    if (copy == NULL || (aid != NULL && copy_ids == NULL)) {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(copy, a + a_lo, sizeof(struct Point) * an);
+    memcpy(copy + an, b + b_lo, sizeof(struct Point) * bn);
+    if (aid != NULL) {
+        memcpy(copy_ids, aid + a_lo, sizeof(int) * an);
+        memcpy(copy_ids + an, bid + b_lo, sizeof(int) * bn);
+    }
+    radix_sort(copy, copy_ids, an, k);
+    radix_sort(copy + an, ids_at(copy_ids, an), bn, k);
+
+    long count = cross_pairs(copy, copy_ids, an, copy + an,
+                             ids_at(copy_ids, an), bn, k, h);
+    free(copy);
+    free(copy_ids);
+    return count;
+}
+
 /*
- * Find the distance between the closest points of array strip of size d.
- * All points in array strip are sorted according to y coordinate. They all
- * have an upper bound on minimum distance as d. Note that this method
- * seems to be a O(n^2) method, but it's a O(n) method as the inner loop
- * runs at most 6 times.
+ * Push to h the pairs of a point of a[] and a point of b[] that are closer
+ * than the heap bound, where a[] and b[] are sorted by coordinate k. aid[]
+ * and bid[] are both NULL or hold the positions of the points. Return the
+ * number of pairs whose distance was computed.
+ *
+ * On the last coordinate this is a window scan. On the others, a[] and b[]
+ * are split together at the median of coordinate k. The pairs within the
+ * lower and within the upper parts are searched recursively. A pair across
+ * the split has both points within the bound of it, and those points are
+ * searched on the next coordinate. The bound then limits every coordinate
+ * in turn, instead of only the last one.
  */
-double strip_closest(struct Point *strip, int size, double d) {
-    double min = d;  // Initialize the minimum distance as d
+static long cross_pairs(struct Point *a, int *aid, int an, struct Point *b,
+                        int *bid, int bn, int k, struct PairHeap *h) {
+    long count = 0;
 
-    qsort(strip, size, sizeof(struct Point), compare_y);
+    if (an == 0 || bn == 0) {
+        return 0;
+    }
+
+    if (k == DIM - 1) {
+        /*
+         * The points of b[] below the window of a[i] are below the window
+         * of every later point of a[] too, because coordinate k only grows
+         * and the bound only shrinks.
+         */
+        int start = 0;
+        for (int i = 0; i < an; i++) {
+            coord_t c = COORD(a[i], k);
+            while (start < bn &&
+                   COORD_DIFF(c, COORD(b[start], k)) >= heap_bound(h)) {
+                start++;
+            }
+            for (int j = start; j < bn &&
+                 COORD_DIFF(COORD(b[j], k), c) < heap_bound(h); j++) {
+                double d = dist(a[i], b[j]);
+                count++;
+                if (d < heap_bound(h)) {
+                    push_cross(h, a, aid, i, b, bid, j, d);
+                }
+            }
+        }
+        return count;
+    }
+
+    if ((long) an * bn <= CROSS_CUTOFF) {
+        for (int i = 0; i < an; i++) {
+            for (int j = 0; j < bn; j++) {
+                double d = dist(a[i], b[j]);
+                count++;
+                if (d < heap_bound(h)) {
+                    push_cross(h, a, aid, i, b, bid, j, d);
+                }
+            }
+        }
+        return count;
+    }
+
+    // Find the split: a[0..ia) and b[0..ib) are the half lowest points.
+    int half = (an + bn) / 2;
+    int lo = half > bn ? half - bn : 0, hi = half < an ? half : an;
+    while (lo < hi) {
+        int ia = lo + (hi - lo) / 2;
+        if (COORD(b[half - ia - 1], k) > COORD(a[ia], k)) {
+            lo = ia + 1;
+        } else {
+            hi = ia;
+        }
+    }
+    int ia = lo, ib = half - lo;
+    coord_t split = ib == bn || (ia < an && COORD(a[ia], k) < COORD(b[ib], k)) ?
+                    COORD(a[ia], k) : COORD(b[ib], k);
+
+    count += cross_pairs(a, aid, ia, b, bid, ib, k, h);
+    count += cross_pairs(a + ia, ids_at(aid, ia), an - ia, b + ib,
+                         ids_at(bid, ib), bn - ib, k, h);
+
+    // The points within the bound of the split on either side
+    double bound = heap_bound(h);
+    int a_lo = ia, a_hi = ia, b_lo = ib, b_hi = ib;
+    while (a_lo > 0 && COORD_DIFF(split, COORD(a[a_lo - 1], k)) < bound) {
+        a_lo--;
+    }
+    while (a_hi < an && COORD_DIFF(COORD(a[a_hi], k), split) < bound) {
+        a_hi++;
+    }
+    while (b_lo > 0 && COORD_DIFF(split, COORD(b[b_lo - 1], k)) < bound) {
+        b_lo--;
+    }
+    while (b_hi < bn && COORD_DIFF(COORD(b[b_hi], k), split) < bound) {
+        b_hi++;
+    }
+
+    count += cross_copies(a, aid, a_lo, ia, b, bid, ib, b_hi, k + 1, h);
+    count += cross_copies(a, aid, ia, a_hi, b, bid, b_lo, ib, k + 1, h);
+    return count;
+}
+
+long cross_closest(struct Point *a, int *aid, int an, struct Point *b,
+                   int *bid, int bn, struct PairHeap *h) {
+    return cross_pairs(a, aid, an, b, bid, bn, 1, h);
+}
+
+/*
+ * Find the closest pair of points in array strip of size size, or return
+ * best if there is none closer. All points in array strip are within best.d
+ * of the dividing line, and strip[0..left) are left of it. Note that this
+ * method seems to be a O(n^2) method, but it's a O(n) method as the inner
+ * loop runs at most 6 times.
+ */
+struct Pair strip_closest(struct Point *strip, int *ids, int size, int left,
+                          struct Pair best) {
+    long comparisons;
+    return strip_closest_count(strip, ids, size, left, best, &comparisons);
+}
+
+/*
+ * The same as strip_closest(), also populating *comparisons with the number
+ * of pairs whose distance was computed.
+ */
+struct Pair strip_closest_count(struct Point *strip, int *ids, int size,
+                                int left, struct Pair best,
+                                long *comparisons) {
+#if DIM > 2
+    /*
+     * A window on y holds every point of the strip close in x and y, however
+     * far apart the points are in the other coordinates, so the two sides
+     * are searched coordinate by coordinate instead.
+     */
+    struct PairHeap h = {&best, 1, 1};
+    sort_y_ids(strip, ids, left);
+    sort_y_ids(strip + left, ids_at(ids, left), size - left);
+    *comparisons = cross_closest(strip, ids, left, strip + left,
+                                 ids_at(ids, left), size - left, &h);
+    return best;
+#else
+    double min = best.d;  // Initialize the minimum distance as d
+    long count = 0;
+
+    sort_y_ids(strip, ids, size);
 
     /*
      * Pick all points one by one and try the next points until the difference
@@ -83,18 +575,101 @@ double strip_closest(struct Point *strip, int size, double d) {
      * loop runs at most 6 times.
      */
     for (int i = 0; i < size; ++i) {
-        for (int j = i + 1; j < size && (strip[j].y - strip[i].y) < min; ++j) {
+        int j;
+        for (j = i + 1; j < size && COORD_DIFF(strip[j].y, strip[i].y) < min; ++j) {
             if (dist(strip[i], strip[j]) < min) {
                 min = dist(strip[i], strip[j]);
+                best.p1 = strip[i];
+                best.p2 = strip[j];
+                best.i1 = ids != NULL ? ids[i] : -1;
+                best.i2 = ids != NULL ? ids[j] : -1;
             }
         }
+        count += j - i - 1;
+    }
+
+    best.d = min;
+    *comparisons = count;
+    return best;
+#endif
+}
+
+/*
+ * Find the range p[*lo..*hi) of the points of p[] within d of the line
+ * x = p[mid].x, where p[] is sorted by x, by binary search on either side of
+ * mid. Return the number of points probed.
+ */
+int strip_bounds(struct Point *p, int n, int mid, double d, int *lo, int *hi) {
+    coord_t mid_x = p[mid].x;
+    int probes = 0;
+
+    // The first point left of mid that is close enough
+    int l = 0, h = mid;
+    while (l < h) {
+        int m = l + (h - l) / 2;
+        if (COORD_DIFF(mid_x, p[m].x) < d) {
+            h = m;
+        } else {
+            l = m + 1;
+        }
+        probes++;
+    }
+    *lo = l;
+
+    // The first point right of mid that is too far
+    l = mid;
+    h = n;
+    while (l < h) {
+        int m = l + (h - l) / 2;
+        if (COORD_DIFF(p[m].x, mid_x) < d) {
+            l = m + 1;
+        } else {
+            h = m;
+        }
+        probes++;
     }
+    *hi = l;
+
+    return probes;
+}
 
-    return min;
+/*
+ * Return a copy of the points of p[] within d of the line x = p[mid].x and
+ * populate *size with their number, like a scan comparing every point with
+ * the line, but p[] must be sorted by x so that only the range found by
+ * strip_bounds() is read. *left is set to the number of them left of
+ * p[mid]. Unless ids is NULL, *ids is set to an array of the positions of
+ * the strip's points in p[]. Release both with free().
+ */
+struct Point *build_strip(struct Point *p, int n, int mid, double d, int *size,
+                          int *left, int **ids) {
+    int lo, hi;
+    strip_bounds(p, n, mid, d, &lo, &hi);
+
+    struct Point *strip = malloc(sizeof(struct Point) * (hi - lo) + 1);
+    if (strip == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(strip, p + lo, sizeof(struct Point) * (hi - lo));
+    if (ids != NULL) {
+        *ids = malloc(sizeof(int) * (hi - lo) + 1);
+        if (*ids == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (int i = lo; i < hi; i++) {
+            (*ids)[i - lo] = i;
+        }
+    }
+    *size = hi - lo;
+    *left = mid - lo;
+    return strip;
 }
 
 /*
- * Return the total number of points stored in the specified file.
+ * Return the total number of points stored in the specified file, which
+ * must be in the original format.
  */
 int total_points(char *f_name) {
     struct stat st_buf;
@@ -115,7 +690,7 @@ int total_points(char *f_name) {
 
 /*
  * Return all input points from the specified file and populate *n with the
- * number of points read.
+ * number of points read. The file must be in the original format.
  */
 void read_points(char *f_name, struct Point *points_arr) {
     int total, bytes_read;
@@ -144,3 +719,182 @@ void read_points(char *f_name, struct Point *points_arr) {
         exit(1);
     }
 }
+
+// Return the name of a coordinate type from a struct PointsHeader.
+static char *type_name(unsigned int type) {
+    char *names[] = {"unknown", "int32", "int64", "float", "double"};
+    return type <= COORD_DOUBLE ? names[type] : names[0];
+}
+
+/*
+ * Return the size of the header of the file of size bytes that starts at
+ * base, after checking that the file holds points of this build's DIM and
+ * coordinate type. *count is set to the number of points.
+ */
+static size_t check_header(char *f_name, char *base, size_t size,
+                           unsigned long *count) {
+    struct PointsHeader *h = (struct PointsHeader *) base;
+
+    if (size >= sizeof(struct PointsHeader) &&
+        memcmp(h->magic, POINTS_MAGIC, sizeof(h->magic)) == 0) {
+        if (h->version != POINTS_VERSION) {
+            fprintf(stderr, "%s has version %u of the format; only version %d "
+                    "is supported.\n", f_name, h->version, POINTS_VERSION);
+            exit(1);
+        }
+        if (h->type != COORD_TYPE || h->dims != DIM) {
+            fprintf(stderr, "%s holds %u-dimensional %s points, but this "
+                    "program was built for %d-dimensional %s points.\n",
+                    f_name, h->dims, type_name(h->type), DIM, COORD_NAME);
+            exit(1);
+        }
+        // Divide instead of multiplying, which a crafted count could wrap.
+        size_t bytes = size - sizeof(struct PointsHeader);
+        if (bytes % sizeof(struct Point) != 0 ||
+            h->count != bytes / sizeof(struct Point)) {
+            fprintf(stderr, "The header of %s does not match its size!\n",
+                    f_name);
+            exit(1);
+        }
+        *count = h->count;
+        return sizeof(struct PointsHeader);
+    }
+
+    // Otherwise it is a count followed by int coordinates, which only match
+    // the default int build. A file of another DIM fails here too.
+    int total = *(int *) base;
+    size_t bytes = size - sizeof(int);
+    if (total < 0 || COORD_TYPE != COORD_INT32 ||
+        bytes != (size_t) total * sizeof(struct Point)) {
+        if (total > 0 && bytes % ((size_t) total * sizeof(int)) == 0) {
+            fprintf(stderr, "%s holds %zu-dimensional int32 points, but this "
+                    "program was built for %d-dimensional %s points.\n", f_name,
+                    bytes / ((size_t) total * sizeof(int)), DIM, COORD_NAME);
+        } else {
+            fprintf(stderr, "The header of %s does not match its size!\n",
+                    f_name);
+        }
+        exit(1);
+    }
+    *count = total;
+    return sizeof(int);
+}
+
+/*
+ * Check the header of the specified file like load_points() without
+ * reading its points. Return the offset of the first point and populate
+ * *count with the number of points, which may exceed INT_MAX.
+ */
+size_t read_header(char *f_name, unsigned long *count) {
+    struct stat st_buf;
+    struct PointsHeader h;
+    int fd;
+
+    fd = open(f_name, O_RDONLY);
+    if (fd == -1) {
+        perror(f_name);
+        exit(1);
+    }
+
+    if (fstat(fd, &st_buf) != 0) {
+        perror("fstat");
+        exit(1);
+    }
+
+    size_t want = st_buf.st_size < (off_t) sizeof(h) ? st_buf.st_size
+                                                     : sizeof(h);
+    if (st_buf.st_size < (off_t) sizeof(int) ||
+        read(fd, &h, want) != (ssize_t) want) {
+        fprintf(stderr, "Failed to read number of points from %s.\n", f_name);
+        exit(1);
+    }
+
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+
+    return check_header(f_name, (char *) &h, st_buf.st_size, count);
+}
+
+/*
+ * Map the specified file into memory and return a pointer to its points
+ * without copying them. The header is checked against the size of the file
+ * and *n is populated with the number of points. The mapping is private, so
+ * the points can be sorted in place without modifying the file. Release the
+ * points with unload_points().
+ */
+struct Point *load_points(char *f_name, int *n) {
+    struct stat st_buf;
+    unsigned long total;
+    size_t header;
+    int fd;
+    char *base;
+
+    fd = open(f_name, O_RDONLY);
+    if (fd == -1) {
+        perror(f_name);
+        exit(1);
+    }
+
+    if (fstat(fd, &st_buf) != 0) {
+        perror("fstat");
+        exit(1);
+    }
+
+    if (st_buf.st_size < (off_t) sizeof(int)) {
+        fprintf(stderr, "Failed to read number of points from %s.\n", f_name);
+        exit(1);
+    }
+
+    // Fault the whole file in up front so that the time spent reading it is
+    // accounted to loading rather than to the first pass over the points.
+    base = mmap(NULL, st_buf.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    if (close(fd) == -1) {
+        perror("close");
+        exit(1);
+    }
+
+    header = check_header(f_name, base, st_buf.st_size, &total);
+    if (total > INT_MAX) {
+        fprintf(stderr, "%s holds %lu points, more than the %d that can be "
+                "processed in memory.\n", f_name, total, INT_MAX);
+        exit(1);
+    }
+
+    *n = total;
+    return (struct Point *) (base + header);
+}
+
+/*
+ * Release the points returned by load_points(). Either header is shorter
+ * than a page, so the mapping starts at the page the points start in.
+ */
+void unload_points(struct Point *points_arr, int n) {
+    long page = sysconf(_SC_PAGESIZE);
+    char *base = (char *) ((unsigned long) points_arr & ~(page - 1));
+    size_t length = (char *) points_arr - base + (size_t) n * sizeof(struct Point);
+
+    if (munmap(base, length) == -1) {
+        perror("munmap");
+        exit(1);
+    }
+}
+
+// Return the current value of a monotonic clock in seconds.
+double get_time() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        perror("clock_gettime");
+        exit(1);
+    }
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -8,36 +8,191 @@ int compare_x(const void *a, const void *b);
 // Needed to sort array of points according to Y coordinate.
 int compare_y(const void* a, const void* b);
 
+// Sort array of points according to X coordinate (a radix sort, not qsort).
+void sort_x(struct Point *p, int n);
+
+// Sort array of points according to Y coordinate (a radix sort, not qsort).
+void sort_y(struct Point *p, int n);
+
+// The same as sort_x(), applying the same permutation to ids[].
+void sort_x_ids(struct Point *p, int *ids, int n);
+
+// The same as sort_y(), applying the same permutation to ids[].
+void sort_y_ids(struct Point *p, int *ids, int n);
+
+/*
+ * The parts of the LSD radix sort shared by sort_x() and the soa engine,
+ * which move the points in their own layouts. There is one pass per byte
+ * of the key of a coordinate, and below RADIX_CUTOFF points an insertion
+ * sort beats setting up the passes.
+ */
+#define RADIX_CUTOFF 64
+#define RADIX_PASSES ((int) sizeof(coord_key_t))
+
+// The digit of key that pass sorts on, a macro so that -O0 builds inline it
+#define RADIX_DIGIT(key, pass) ((unsigned int) ((key) >> (8 * (pass))) & 0xff)
+
+/*
+ * Populate count[pass][digit] with the number of the n coordinates at keys,
+ * stride bytes apart, whose key has that digit in that pass, for every
+ * pass in one scan.
+ */
+void radix_count(const coord_t *keys, size_t stride, int n,
+                 size_t count[RADIX_PASSES][256]);
+
+/*
+ * Populate pos[] with the position at which the keys with each digit start
+ * in a pass whose digits count[] counts. Return 0 instead if all n keys
+ * have the digit first, so that the pass would move nothing and can be
+ * skipped.
+ */
+int radix_starts(size_t count[256], int n, unsigned int first,
+                 size_t pos[256]);
+
 // A utility function to find the distance between two points.
 double dist(struct Point p1, struct Point p2);
 
+// Return whether p1 and p2 have the same coordinates.
+int same_point(struct Point p1, struct Point p2);
+
+// Print the coordinates of p in parentheses, separated by commas.
+void print_point(FILE *fp, struct Point p);
+
 /*
- * Brute Force method to find minimal distance between two points in an
- * array p of size n.
+ * Read the DIM coordinates of *p from the string s, separated by spaces.
+ * Return 1 on success and 0 if s does not start with DIM integers.
  */
-double brute_force(struct Point *p, int n);
+int parse_point(char *s, struct Point *p);
+
+/*
+ * Brute Force method to find the closest pair of points in an array p of
+ * size n. If there are fewer than two points, the distance is DBL_MAX and
+ * the positions are -1.
+ */
+struct Pair brute_force(struct Point *p, int n);
 
 // Return smallest of two double values 
 double min(double x, double y);
 
+// Return the closer of two pairs
+struct Pair min_pair(struct Pair a, struct Pair b);
+
 /*
- * Find the distance between the closest points of array strip of size d.
- * All points in array strip are sorted according to y coordinate. They all
- * have an upper bound on minimum distance as d. Note that this method
- * seems to be a O(n^2) method, but it's a O(n) method as the inner loop
- * runs at most 6 times.
+ * Return pair with the positions of its points moved by offset, for a pair
+ * found in a subarray that starts at position offset.
  */
-double strip_closest(struct Point *strip, int size, double d);
+struct Pair shift_pair(struct Pair pair, int offset);
 
 /*
- * Return the total number of points stored in the specified file.
+ * A bounded max-heap of the k closest pairs found so far. pairs[0] is the
+ * farthest of them, so its distance bounds the pairs still worth finding.
+ */
+struct PairHeap {
+    struct Pair *pairs;
+    int size;
+    int k;
+};
+
+void heap_init(struct PairHeap *h, int k);
+void heap_free(struct PairHeap *h);
+double heap_bound(struct PairHeap *h);
+void heap_push(struct PairHeap *h, struct Pair pair);
+void heap_sort(struct PairHeap *h);
+
+/*
+ * Push to h the pairs of a point of a[] and a point of b[] that are closer
+ * than the heap bound, where a[] and b[] lie on either side of a dividing
+ * line in x and are both sorted by y. aid[] and bid[] hold the positions of
+ * the points, or are both NULL. Return the number of pairs whose distance
+ * was computed. Past 2D the search recurses on each further coordinate, so
+ * points far apart in z or w are not compared just because they are close
+ * in x and y.
+ */
+long cross_closest(struct Point *a, int *aid, int an, struct Point *b,
+                   int *bid, int bn, struct PairHeap *h);
+
+// Most cells a grid engine numbers across the bounding box of its points
+#define CELLS_MAX (1 << 30)
+
+/*
+ * Return the side of the grid cells for the closest distance d (DBL_MAX if
+ * it is not known yet) over points whose bounding box is extent wide:
+ * twice d, but wide enough that the box spans at most CELLS_MAX cells.
+ * Cell numbers measured from the corner of the box then fit in an int
+ * whatever the coordinate type.
+ */
+double cell_side(double d, double extent);
+
+/*
+ * Find the closest pair of points in array strip of size size, or return
+ * best if there is none closer. All points in array strip are within best.d
+ * of the dividing line; strip[0..left) are left of it and strip[left..size)
+ * right of it. Note that this method seems to be a O(n^2) method, but it's
+ * a O(n) method as the inner loop runs at most 6 times; past 2D the two
+ * sides are searched with cross_closest(). ids[] holds the positions of the
+ * strip's points, which a pair found in the strip reports; if it is NULL
+ * they are reported as -1.
+ */
+struct Pair strip_closest(struct Point *strip, int *ids, int size, int left,
+                          struct Pair best);
+
+/*
+ * The same as strip_closest(), also populating *comparisons with the number
+ * of pairs whose distance was computed.
+ */
+struct Pair strip_closest_count(struct Point *strip, int *ids, int size,
+                                int left, struct Pair best,
+                                long *comparisons);
+
+/*
+ * Find the range p[*lo..*hi) of the points of p[] within d of the line
+ * x = p[mid].x, where p[] is sorted by x, by binary search on either side of
+ * mid. Return the number of points probed.
+ */
+int strip_bounds(struct Point *p, int n, int mid, double d, int *lo, int *hi);
+
+/*
+ * Return a copy of the points of p[] within d of the line x = p[mid].x and
+ * populate *size with their number and *left with the number of them left
+ * of p[mid]. p[] must be sorted by x; only the points of the strip are
+ * read. Unless ids is NULL, *ids is set to an array of the positions of the
+ * strip's points in p[]. Release both with free().
+ */
+struct Point *build_strip(struct Point *p, int n, int mid, double d, int *size,
+                          int *left, int **ids);
+
+/*
+ * Return the total number of points stored in the specified file, which
+ * must be in the original format.
  */
 int total_points(char *f_name);
 
 /*
  * Return all input points from the specified file and populate *n with the
- * number of points read.
+ * number of points read. The file must be in the original format.
  */
 void read_points(char *f_name, struct Point *points_arr);
 
+/*
+ * Check the header of the specified file like load_points() without
+ * reading its points. Return the offset of the first point and populate
+ * *count with the number of points, which may exceed INT_MAX.
+ */
+size_t read_header(char *f_name, unsigned long *count);
+
+/*
+ * Map the specified file into memory and return a pointer to its points
+ * without copying them. The header is checked against the size of the file
+ * and *n is populated with the number of points. The mapping is private, so
+ * the points can be sorted in place without modifying the file. Release the
+ * points with unload_points().
+ */
+struct Point *load_points(char *f_name, int *n);
+
+// Release the points returned by load_points().
+void unload_points(struct Point *points_arr, int n);
+
+// Return the current value of a monotonic clock in seconds.
+double get_time();
+
 #endif /* _UTILITIES_H */